@@ -0,0 +1,455 @@
+/*
+* Copyright 2012-2017 Rochus Keller <mailto:me@rochus-keller.info>
+*
+* This file is part of the AdaViewer application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.info.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "AdaByteLexer.h"
+#include "AdaTokenStore.h"
+#include <QByteArray>
+#include <string.h>
+using namespace Ada;
+
+// Decodes one UTF-8 sequence; malformed, overlong or truncated sequences and surrogates give U+FFFD
+// for the first byte, so the lexer always makes progress.
+static inline int _decodeUtf8( const uchar* p, const uchar* end, uint& ucs )
+{
+	const uchar b = p[0];
+	int n;
+	uint min;
+	if( b < 0x80 )
+	{
+		ucs = b;
+		return 1;
+	}else if( ( b & 0xe0 ) == 0xc0 )
+	{
+		ucs = b & 0x1f;
+		n = 2;
+		min = 0x80;
+	}else if( ( b & 0xf0 ) == 0xe0 )
+	{
+		ucs = b & 0x0f;
+		n = 3;
+		min = 0x800;
+	}else if( ( b & 0xf8 ) == 0xf0 )
+	{
+		ucs = b & 0x07;
+		n = 4;
+		min = 0x10000;
+	}else
+	{
+		ucs = 0xfffd;
+		return 1;
+	}
+	if( end - p < n )
+	{
+		ucs = 0xfffd;
+		return 1;
+	}
+	for( int i = 1; i < n; i++ )
+	{
+		if( ( p[i] & 0xc0 ) != 0x80 )
+		{
+			ucs = 0xfffd;
+			return 1;
+		}
+		ucs = ( ucs << 6 ) | ( p[i] & 0x3f );
+	}
+	if( ucs < min || ucs > 0x10ffff || ( ucs >= 0xd800 && ucs <= 0xdfff ) )
+	{
+		ucs = 0xfffd;
+		return 1;
+	}
+	return n;
+}
+
+static inline quint32 _units( uint ucs )
+{
+	return ( ucs > 0xffff ) ? 2 : 1;
+}
+
+QString ByteLexer::Token::getText() const
+{
+	if( d_src == 0 )
+		return QString();
+	if( d_enc == Latin1 )
+		return QString::fromLatin1( d_src, d_byteLen );
+	else
+		return QString::fromUtf8( d_src, d_byteLen );
+}
+
+QString ByteLexer::Token::getString() const
+{
+	if( d_src == 0 )
+		return QString();
+	const QString text = getText();
+	const LexerCore::Token t( LexerCore::TokenType( d_type ), d_line, d_col, text.size(), d_off,
+							  text.constData(), LexerCore::Error( d_err ) );
+	return t.getString();
+}
+
+LexerCore::Token ByteLexer::Token::toToken() const
+{
+	return LexerCore::Token( LexerCore::TokenType( d_type ), d_line, d_col, d_len, d_off, 0,
+							 LexerCore::Error( d_err ) );
+}
+
+ByteLexer::ByteLexer():
+	d_begin(0),d_end(0),d_cur(0),d_line(0),d_lineLen(0),d_lineNr(0),d_pos(0),d_colNr(0),d_lineOff(0),
+	d_enc(Utf8),d_lastTokenType(LexerCore::T_Invalid),d_lowSurrogate(false)
+{
+}
+
+void ByteLexer::setBuffer(const char* begin, const char* end, ByteLexer::Encoding enc)
+{
+	d_begin = begin;
+	d_end = end;
+	d_enc = enc;
+	reset();
+}
+
+void ByteLexer::setBuffer(const QByteArray& bytes, ByteLexer::Encoding enc)
+{
+	setBuffer( bytes.constData(), bytes.constData() + bytes.size(), enc );
+}
+
+void ByteLexer::reset()
+{
+	d_cur = d_begin;
+	d_line = 0;
+	d_lineLen = 0;
+	d_lineNr = 0;
+	d_pos = 0;
+	d_colNr = 0;
+	d_lineOff = 0;
+	d_lastTokenType = LexerCore::T_Invalid;
+	d_lowSurrogate = false;
+}
+
+ByteLexer::Token ByteLexer::nextToken()
+{
+	if( d_lowSurrogate )
+	{
+		d_lowSurrogate = false;
+		// same position as LexerCore; the error message names the whole character, not the surrogate
+		uint ucs;
+		return token( LexerCore::T_Invalid, decode( d_pos, ucs ), 1, LexerCore::E_UnexpectedChar );
+	}
+	skipWhiteSpace();
+	while( d_pos >= d_lineLen )
+	{
+		if( d_cur >= d_end )
+			return token( LexerCore::T_EOF, 0, 0 );
+		nextLine();
+		skipWhiteSpace();
+	}
+	const uchar ch = d_line[d_pos];
+	switch( ch )
+	{
+	case '&':
+		return token( LexerCore::T_Ampers );
+	case '(':
+		return token( LexerCore::T_LParen );
+	case ')':
+		return token( LexerCore::T_RParen );
+	case '*':
+		if( lookAhead(1) == '*' )
+			return token( LexerCore::T_DoubleStar, 2, 2 );
+		else
+			return token( LexerCore::T_Star );
+	case '+':
+		return token( LexerCore::T_Plus );
+	case ',':
+		return token( LexerCore::T_Comma );
+	case '-':
+		if( lookAhead(1) == '-' )
+			return token( LexerCore::T_Comment, d_lineLen - d_pos, utf16Length( d_pos, d_lineLen ) );
+		else
+			return token( LexerCore::T_Minus );
+	case '.':
+		if( lookAhead(1) == '.' )
+			return token( LexerCore::T_DoubleDot, 2, 2 );
+		else
+			return token( LexerCore::T_Dot );
+	case '/':
+		if( lookAhead(1) == '=' )
+			return token( LexerCore::T_Neq, 2, 2 );
+		else
+			return token( LexerCore::T_Slash );
+	case ':':
+		if( lookAhead(1) == '=' )
+			return token( LexerCore::T_Assig, 2, 2 );
+		else
+			return token( LexerCore::T_Colon );
+	case ';':
+		return token( LexerCore::T_Semicolon );
+	case '<':
+		switch( lookAhead(1) )
+		{
+		case '=':
+			return token( LexerCore::T_Leq, 2, 2 );
+		case '<':
+			return token( LexerCore::T_LLBrack, 2, 2 );
+		case '>':
+			return token( LexerCore::T_Box, 2, 2 );
+		default:
+			return token( LexerCore::T_Lt );
+		}
+	case '=':
+		if( lookAhead(1) == '>' )
+			return token( LexerCore::T_Arrow, 2, 2 );
+		else
+			return token( LexerCore::T_Eq );
+	case '>':
+		switch( lookAhead(1) )
+		{
+		case '=':
+			return token( LexerCore::T_Geq, 2, 2 );
+		case '>':
+			return token( LexerCore::T_RLBrack, 2, 2 );
+		default:
+			return token( LexerCore::T_Gt );
+		}
+	case '|':
+		return token( LexerCore::T_Bar );
+	case '\'':
+		if( d_pos + 1 < d_lineLen )
+		{
+			// the character between the ticks may take more than one byte
+			uint ucs;
+			const int n = decode( d_pos + 1, ucs );
+			if( _units( ucs ) == 1 && lookAhead( n + 1 ) == '\'' )
+				return token( LexerCore::T_Character, n + 2, 3 );
+		}
+		return token( LexerCore::T_Tick );
+	case '"':
+		return string();
+	default:
+		break;
+	}
+	if( ch < 0x80 )
+	{
+		if( LexerCore::isDigitChar( ch ) )
+			return numeric();
+		else if( LexerCore::isLetterChar( ch ) )
+			return ident();
+		else
+			return token( LexerCore::T_Invalid, 1, 1, LexerCore::E_UnexpectedChar );
+	}
+	uint ucs;
+	const int n = decode( d_pos, ucs );
+	if( ucs > 0xffff )
+	{
+		// LexerCore sees two surrogates and reports each of them as unexpected character
+		Token t = token( LexerCore::T_Invalid, 0, 1, LexerCore::E_UnexpectedChar );
+		t.d_byteLen = n;
+		d_lowSurrogate = true;
+		return t;
+	}else if( LexerCore::isLetterChar( ucs ) )
+		return ident();
+	else
+		return token( LexerCore::T_Invalid, n, 1, LexerCore::E_UnexpectedChar );
+}
+
+int ByteLexer::tokenize(TokenStore& out)
+{
+	out.clear();
+	Token t = nextToken();
+	while( !t.isEof() )
+	{
+		out.append( t.toToken() );
+		t = nextToken();
+	}
+	return out.getCount();
+}
+
+void ByteLexer::nextLine()
+{
+	if( d_line != 0 )
+		// d_colNr is the UTF-16 length of the finished line; the line end is ASCII
+		d_lineOff += d_colNr + ( d_cur - ( d_line + d_lineLen ) );
+	d_pos = 0;
+	d_colNr = 0;
+	d_lineNr++;
+	// same line ends as LexerCore, i.e. \n or the end of the buffer, a preceding \r is dropped
+	const char* p = static_cast<const char*>( ::memchr( d_cur, '\n', d_end - d_cur ) );
+	if( p == 0 )
+		p = d_end;
+	d_line = d_cur;
+	d_lineLen = p - d_cur;
+	if( d_lineLen > 0 && d_line[d_lineLen - 1] == '\r' )
+		d_lineLen--;
+	d_cur = ( p < d_end ) ? p + 1 : p;
+}
+
+void ByteLexer::skipWhiteSpace()
+{
+	while( d_pos < d_lineLen )
+	{
+		const uchar ch = d_line[d_pos];
+		if( ch < 0x80 )
+		{
+			if( !LexerCore::isSpaceChar( ch ) )
+				break;
+			d_pos++;
+			d_colNr++;
+		}else
+		{
+			uint ucs;
+			const int n = decode( d_pos, ucs );
+			if( ucs > 0xffff || !LexerCore::isSpaceChar( ucs ) )
+				break;
+			d_pos += n;
+			d_colNr++;
+		}
+	}
+}
+
+char ByteLexer::lookAhead(quint32 off) const
+{
+	if( d_pos + off < d_lineLen )
+		return d_line[ d_pos + off ];
+	else
+		return 0;
+}
+
+int ByteLexer::decode(quint32 pos, uint& ucs) const
+{
+	const uchar* p = reinterpret_cast<const uchar*>( d_line + pos );
+	if( d_enc == Latin1 || *p < 0x80 )
+	{
+		ucs = *p;
+		return 1;
+	}else
+		return _decodeUtf8( p, reinterpret_cast<const uchar*>( d_line + d_lineLen ), ucs );
+}
+
+quint32 ByteLexer::utf16Length(quint32 from, quint32 to) const
+{
+	if( d_enc == Latin1 )
+		return to - from;
+	quint32 units = 0;
+	while( from < to )
+	{
+		if( uchar( d_line[from] ) < 0x80 )
+		{
+			from++;
+			units++;
+		}else
+		{
+			uint ucs;
+			from += decode( from, ucs );
+			units += _units( ucs );
+		}
+	}
+	return units;
+}
+
+ByteLexer::Token ByteLexer::token(LexerCore::TokenType tt, quint32 bytes, quint32 units, LexerCore::Error err)
+{
+	Token t( tt, d_lineNr, d_colNr, units, d_lineOff + d_colNr, ( d_line - d_begin ) + d_pos, bytes,
+			 d_line + d_pos, Encoding(d_enc), err );
+	d_pos += bytes;
+	d_colNr += units;
+	if( tt != LexerCore::T_Comment && tt != LexerCore::T_EOF )
+		d_lastTokenType = tt; // same as LexerCore
+	return t;
+}
+
+ByteLexer::Token ByteLexer::string()
+{
+	quint32 p = d_pos + 1;
+	quint32 units = 1;
+	while( true )
+	{
+		if( p >= d_lineLen )
+			return token( LexerCore::T_Invalid, d_lineLen - d_pos, utf16Length( d_pos, d_lineLen ),
+						  LexerCore::E_NonTerminatedString );
+		const uchar ch = d_line[p];
+		if( ch == '"' )
+		{
+			if( p + 1 < d_lineLen && d_line[p + 1] == '"' )
+			{
+				p += 2;
+				units += 2;
+			}else
+				break; // End of String
+		}else if( ch < 0x80 )
+		{
+			if( !LexerCore::isPrintChar( ch ) )
+				return token( LexerCore::T_Invalid, d_lineLen - d_pos, utf16Length( d_pos, d_lineLen ),
+							  LexerCore::E_NonTerminatedString );
+			p++;
+			units++;
+		}else
+		{
+			uint ucs;
+			const int n = decode( p, ucs );
+			// LexerCore checks both surrogates of a character outside the BMP
+			const bool print = ( ucs <= 0xffff ) ? LexerCore::isPrintChar( ucs ) :
+								 ( LexerCore::isPrintChar( QChar::highSurrogate( ucs ) ) &&
+								   LexerCore::isPrintChar( QChar::lowSurrogate( ucs ) ) );
+			if( !print )
+				return token( LexerCore::T_Invalid, d_lineLen - d_pos, utf16Length( d_pos, d_lineLen ),
+							  LexerCore::E_NonTerminatedString );
+			p += n;
+			units += _units( ucs );
+		}
+	}
+	return token( LexerCore::T_String, p - d_pos + 1, units + 1 );
+}
+
+ByteLexer::Token ByteLexer::ident()
+{
+	// the first character is already known to be a letter
+	quint32 p = d_pos;
+	quint32 units = 0;
+	while( p < d_lineLen )
+	{
+		const uchar ch = d_line[p];
+		if( ch < 0x80 )
+		{
+			if( !LexerCore::isIdentChar( ch ) )
+				break;
+			p++;
+		}else
+		{
+			uint ucs;
+			const int n = decode( p, ucs );
+			if( ucs > 0xffff || !LexerCore::isIdentChar( ucs ) )
+				break;
+			p += n;
+		}
+		units++;
+	}
+	const LexerCore::TokenType tt = LexerCore::findReservedWord( d_line + d_pos, p - d_pos );
+	if( d_lastTokenType == LexerCore::T_Tick )
+		return token( LexerCore::T_Attribute, p - d_pos, units );
+	else if( tt != LexerCore::T_Invalid )
+		return token( tt, p - d_pos, units );
+	else
+		return token( LexerCore::T_Identifier, p - d_pos, units );
+}
+
+ByteLexer::Token ByteLexer::numeric()
+{
+	// the first character is already known to be an ASCII digit; all characters of a numeric literal
+	// are ASCII, so bytes and UTF-16 code units are the same
+	NumberParser np( d_line, d_lineLen, d_pos );
+	if( !np.parse() )
+		return token( LexerCore::T_Invalid, np.getOff(), np.getOff(), np.getError() );
+	return token( LexerCore::T_Number, np.getOff(), np.getOff() );
+}
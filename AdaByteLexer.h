@@ -0,0 +1,97 @@
+#ifndef ADABYTELEXER_H
+#define ADABYTELEXER_H
+
+/*
+* Copyright 2012-2017 Rochus Keller <mailto:me@rochus-keller.info>
+*
+* This file is part of the AdaViewer application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.info.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "AdaLexer.h"
+
+class QByteArray;
+
+namespace Ada
+{
+	// Lexer working directly on Latin-1 or UTF-8 encoded bytes, e.g. a QByteArray or a file mapped with
+	// QFile::map(); the text is not converted to UTF-16. Multi-byte UTF-8 sequences are only decoded where
+	// the lexer has to look at the character, i.e. in identifiers, strings, comments and for non-ASCII
+	// white space. Columns, offsets and lengths of the tokens are counted in UTF-16 code units, so they are
+	// the same as LexerCore reports for the decoded text and can be used with QTextDocument or TokenStore.
+	// Differences to LexerCore: numeric literals only consist of ASCII digits, other decimal digits are
+	// reported as unexpected characters. Malformed UTF-8 is read as one U+FFFD per byte.
+	class ByteLexer
+	{
+	public:
+		enum Encoding { Latin1, Utf8 };
+		struct Token
+		{
+			quint8 d_type;
+			quint8 d_err;        // Error of T_Invalid tokens, otherwise E_None
+			quint8 d_enc;        // Encoding of d_src
+			quint32 d_line;
+			quint32 d_col, d_len; // in UTF-16 code units
+			quint32 d_off;       // in UTF-16 code units from the start of the buffer
+			quint32 d_byteOff, d_byteLen;
+			const char* d_src;   // first byte of the token in the source buffer
+			Token(LexerCore::TokenType t = LexerCore::T_EOF, quint32 line = 0, quint32 col = 0, quint32 len = 0,
+				  quint32 off = 0, quint32 byteOff = 0, quint32 byteLen = 0, const char* src = 0,
+				  Encoding enc = Utf8, LexerCore::Error err = LexerCore::E_None ):
+				d_type(t),d_err(err),d_enc(enc),d_line(line),d_col(col),d_len(len),d_off(off),
+				d_byteOff(byteOff),d_byteLen(byteLen),d_src(src){}
+			QString getText() const; // decoded source of the token
+			QString getString() const; // value of the token like LexerCore::Token::getString()
+			LexerCore::Token toToken() const; // same position and type, without source
+			bool isValid() const { return d_type != LexerCore::T_EOF && d_type != LexerCore::T_Invalid; }
+			bool isEof() const { return d_type == LexerCore::T_EOF; }
+		};
+
+		ByteLexer();
+
+		void setBuffer( const char* begin, const char* end, Encoding = Utf8 ); // buffer must stay unchanged while lexing
+		void setBuffer( const QByteArray&, Encoding = Utf8 ); // byte array must outlive the lexing
+		Encoding getEncoding() const { return Encoding(d_enc); }
+		void reset();
+		Token nextToken();
+		int tokenize( TokenStore& ); // replaces the contents of the store by the remaining tokens up to EOF
+	protected:
+		void nextLine();
+		void skipWhiteSpace();
+		char lookAhead( quint32 off = 1 ) const;
+		int decode( quint32 pos, uint& ucs ) const; // number of bytes of the character at d_line[pos]
+		quint32 utf16Length( quint32 from, quint32 to ) const;
+		Token token( LexerCore::TokenType, quint32 bytes = 1, quint32 units = 1,
+					 LexerCore::Error err = LexerCore::E_None );
+		Token string();
+		Token ident();
+		Token numeric();
+	private:
+		const char* d_begin;
+		const char* d_end;
+		const char* d_cur;
+		const char* d_line;
+		quint32 d_lineLen;  // in bytes, without line end
+		quint32 d_lineNr;
+		quint32 d_pos;      // byte position in the line
+		quint32 d_colNr;    // UTF-16 column of d_pos
+		quint32 d_lineOff;  // UTF-16 offset of the line
+		quint8 d_enc;
+		quint8 d_lastTokenType;
+		bool d_lowSurrogate; // the second half of an unexpected character outside the BMP is pending
+	};
+}
+
+#endif // ADABYTELEXER_H
@@ -0,0 +1,216 @@
+/*
+* Copyright 2012-2017 Rochus Keller <mailto:me@rochus-keller.info>
+*
+* This file is part of the AdaViewer application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.info.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "AdaDeclIndex.h"
+#include "AdaHighlighter.h"
+#include "AdaLexer.h"
+using namespace Ada;
+
+DeclIndex::Kind DeclIndex::Entry::kind() const
+{
+	for( int k = K_Max - 1; k > K_None; k-- )
+		if( d_count[k] > 0 )
+			return Kind(k);
+	return K_None;
+}
+
+DeclIndex::Kind DeclIndex::classify(const QString& lowerName) const
+{
+	QHash<QString,Entry>::const_iterator i = d_entries.find( lowerName );
+	if( i == d_entries.end() )
+		return K_None;
+	else
+		return i.value().kind();
+}
+
+void DeclIndex::count(const Decl& d, int delta)
+{
+	Entry& e = d_entries[d.d_name];
+	const Kind before = e.kind();
+	e.d_count[d.d_kind] += delta;
+	const Kind after = e.kind();
+	if( after == K_None )
+		d_entries.remove( d.d_name );
+	if( before != after )
+		d_changed[ hashName( d.d_name.constData(), d.d_name.size() ) ] = tick();
+}
+
+void DeclIndex::add(const Decls& decls)
+{
+	for( int i = 0; i < decls.size(); i++ )
+		count( decls[i], 1 );
+}
+
+void DeclIndex::remove(const Decls& decls)
+{
+	for( int i = 0; i < decls.size(); i++ )
+		count( decls[i], -1 );
+}
+
+void DeclIndex::clear()
+{
+	d_entries.clear();
+	d_changed.clear();
+	d_users.clear();
+}
+
+void DeclIndex::addUser(BlockData* block, const QVector<uint>& nameHashes)
+{
+	for( int i = 0; i < nameHashes.size(); i++ )
+		d_users[nameHashes[i]].insert( block );
+}
+
+void DeclIndex::removeUser(BlockData* block, const QVector<uint>& nameHashes)
+{
+	for( int i = 0; i < nameHashes.size(); i++ )
+	{
+		QHash<uint,QSet<BlockData*> >::iterator j = d_users.find( nameHashes[i] );
+		if( j == d_users.end() )
+			continue; // after clear()
+		j.value().remove( block );
+		if( j.value().isEmpty() )
+			d_users.erase( j );
+	}
+}
+
+void DeclIndex::takeStale(QList<BlockData*>& out)
+{
+	// only the users of the changed names are looked at, not all blocks of the document
+	QSet<BlockData*> stale;
+	QHash<uint,quint32>::const_iterator i;
+	for( i = d_changed.begin(); i != d_changed.end(); ++i )
+	{
+		QHash<uint,QSet<BlockData*> >::const_iterator j = d_users.find( i.key() );
+		if( j == d_users.end() )
+			continue;
+		QSet<BlockData*>::const_iterator b;
+		for( b = j.value().begin(); b != j.value().end(); ++b )
+		{
+			if( (*b)->d_stamp < i.value() )
+				stale.insert( *b );
+		}
+	}
+	d_changed.clear();
+	out = stale.toList();
+}
+
+uint DeclIndex::hashName(const QChar* name, int len)
+{
+	uint h = 0;
+	for( int i = 0; i < len; i++ )
+		h = 31 * h + name[i].toLower().unicode();
+	return h;
+}
+
+static inline QString _name( const QString& text, const BlockData& d, int i )
+{
+	return text.mid( d.getCol( i ), d.getLength( i ) ).toLower();
+}
+
+static int _lastOfDotted( const BlockData& d, int i, int n )
+{
+	// Ada.Text_IO declares Text_IO
+	while( i + 2 < n && d.getType( i + 1 ) == LexerCore::T_Dot && d.getType( i + 2 ) == LexerCore::T_Identifier )
+		i += 2;
+	return i;
+}
+
+void DeclIndex::extract(const QString& text, const BlockData& d, Decls& out)
+{
+	// Only looks at the tokens of the block; a declaration split after its keyword is not found
+	int n = d.getCount();
+	if( n > 0 && d.getType( n - 1 ) == LexerCore::T_Comment )
+		n--; // comments always end the line
+	int i = 0;
+	while( i < n )
+	{
+		const quint8 t = d.getType( i );
+		const quint8 next = ( i + 1 < n ) ? d.getType( i + 1 ) : quint8(LexerCore::T_EOF);
+		switch( t )
+		{
+		case LexerCore::T_type:
+		case LexerCore::T_subtype:
+			if( next == LexerCore::T_Identifier )
+			{
+				out.append( Decl( _name( text, d, i + 1 ), K_Type ) );
+				i += 2;
+				continue;
+			}
+			break;
+		case LexerCore::T_procedure:
+		case LexerCore::T_function:
+		case LexerCore::T_entry:
+			if( next == LexerCore::T_Identifier )
+			{
+				const int j = _lastOfDotted( d, i + 1, n );
+				out.append( Decl( _name( text, d, j ), K_Subprogram ) );
+				i = j + 1;
+				continue;
+			}
+			break;
+		case LexerCore::T_package:
+		case LexerCore::T_task:
+		case LexerCore::T_protected:
+			{
+				int j = i + 1;
+				if( next == LexerCore::T_body )
+					j++;
+				if( j < n && d.getType( j ) == LexerCore::T_Identifier )
+				{
+					j = _lastOfDotted( d, j, n );
+					out.append( Decl( _name( text, d, j ), K_Package ) );
+					i = j + 1;
+					continue;
+				}
+			}
+			break; // "task type" is found by T_type
+		case LexerCore::T_Identifier:
+			{
+				// "A, B : T" at the start of a declaration; statements start with an identifier too,
+				// but are never followed by a colon except for labels of loops and blocks
+				const quint8 prev = ( i > 0 ) ? d.getType( i - 1 ) : quint8(LexerCore::T_Semicolon);
+				if( prev != LexerCore::T_Semicolon && prev != LexerCore::T_LParen && prev != LexerCore::T_is &&
+						prev != LexerCore::T_declare && prev != LexerCore::T_private )
+					break;
+				int j = i + 1;
+				while( j + 1 < n && d.getType( j ) == LexerCore::T_Comma && d.getType( j + 1 ) == LexerCore::T_Identifier )
+					j += 2;
+				if( j >= n || d.getType( j ) != LexerCore::T_Colon )
+				{
+					i = j;
+					continue;
+				}
+				const quint8 after = ( j + 1 < n ) ? d.getType( j + 1 ) : quint8(LexerCore::T_EOF);
+				if( after == LexerCore::T_loop || after == LexerCore::T_for || after == LexerCore::T_while ||
+						after == LexerCore::T_declare || after == LexerCore::T_begin )
+				{
+					i = j + 1;
+					continue;
+				}
+				for( int k = i; k < j; k += 2 )
+					out.append( Decl( _name( text, d, k ), K_Object ) );
+				i = j + 1;
+				continue;
+			}
+		default:
+			break;
+		}
+		i++;
+	}
+}
@@ -0,0 +1,82 @@
+#ifndef ADADECLINDEX_H
+#define ADADECLINDEX_H
+
+/*
+* Copyright 2012-2017 Rochus Keller <mailto:me@rochus-keller.info>
+*
+* This file is part of the AdaViewer application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.info.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <QHash>
+#include <QList>
+#include <QSet>
+#include <QString>
+#include <QVector>
+
+namespace Ada
+{
+	class BlockData;
+
+	// Names declared in a document with the kind of their declaration. The declarations are found per
+	// block, so an edit only replaces those of the blocks highlighted again. Names are case folded.
+	class DeclIndex
+	{
+	public:
+		enum Kind { K_None, K_Object, K_Subprogram, K_Package, K_Type, K_Max }; // ascending priority
+
+		struct Decl
+		{
+			QString d_name; // lower case
+			quint8 d_kind;
+			Decl( const QString& name = QString(), quint8 kind = K_None ):d_name(name),d_kind(kind) {}
+			bool operator==( const Decl& rhs ) const { return d_kind == rhs.d_kind && d_name == rhs.d_name; }
+		};
+		typedef QList<Decl> Decls;
+
+		DeclIndex():d_clock(0) {}
+		Kind classify( const QString& lowerName ) const;
+		void add( const Decls& );
+		void remove( const Decls& );
+		void clear();
+
+		// Each highlighted block gets a stamp and is registered as a user of the names it contains
+		// (sorted hashes without duplicates). The block is stale if the classification of one of
+		// its names changed after its stamp.
+		quint32 tick() { return ++d_clock; }
+		void addUser( BlockData*, const QVector<uint>& nameHashes );
+		void removeUser( BlockData*, const QVector<uint>& nameHashes );
+		void takeStale( QList<BlockData*>& out ); // and clears the changes
+		bool hasChanges() const { return !d_changed.isEmpty(); }
+		void clearChanges() { d_changed.clear(); }
+
+		static uint hashName( const QChar* name, int len ); // case folded
+		static void extract( const QString& text, const BlockData&, Decls& out );
+	private:
+		void count( const Decl&, int delta );
+		struct Entry
+		{
+			quint32 d_count[K_Max];
+			Entry() { for( int i = 0; i < K_Max; i++ ) d_count[i] = 0; }
+			Kind kind() const;
+		};
+		QHash<QString,Entry> d_entries;
+		QHash<uint,quint32> d_changed; // name hash -> stamp of the last change
+		QHash<uint,QSet<BlockData*> > d_users; // name hash -> blocks using the name
+		quint32 d_clock;
+	};
+}
+
+#endif // ADADECLINDEX_H
@@ -35,6 +35,12 @@
 #include <QSettings>
 #include <QFontDialog>
 #include <QShortcut>
+#include <QLineEdit>
+#include <QLabel>
+#include <QToolButton>
+#include <QHBoxLayout>
+#include <QVBoxLayout>
+#include <QtConcurrentRun>
 
 // adaptiert aus Lua::CodeEditor
 
@@ -116,12 +122,96 @@ private:
 	Editor* d_codeEditor;
     int d_start;
 };
+
+class _FindBar : public QWidget
+{
+public:
+	QLineEdit* d_edit;
+	QLabel* d_count;
+	QWidget* d_replaceRow;
+	QLineEdit* d_replace;
+
+	_FindBar(Editor* editor):QWidget(editor)
+	{
+		setAutoFillBackground( true );
+		QVBoxLayout* vbox = new QVBoxLayout( this );
+		vbox->setMargin( 2 );
+		vbox->setSpacing( 2 );
+		QHBoxLayout* hbox = new QHBoxLayout();
+		hbox->setMargin( 0 );
+		vbox->addLayout( hbox );
+		hbox->addWidget( new QLabel( Editor::tr("Find:"), this ) );
+		d_edit = new QLineEdit( this );
+		QObject::connect( d_edit, SIGNAL(textChanged(QString)), editor, SLOT(onFindEdited(QString)) );
+		QObject::connect( d_edit, SIGNAL(returnPressed()), editor, SLOT(onFindNext()) );
+		hbox->addWidget( d_edit, 1 );
+		QToolButton* next = new QToolButton( this );
+		next->setText( Editor::tr("Next") );
+		QObject::connect( next, SIGNAL(clicked()), editor, SLOT(onFindNext()) );
+		hbox->addWidget( next );
+		d_count = new QLabel( this );
+		d_count->setMinimumWidth( fontMetrics().width( QLatin1String("0000000 matches") ) );
+		hbox->addWidget( d_count );
+		QToolButton* close = new QToolButton( this );
+		close->setText( QLatin1String("x") );
+		close->setAutoRaise( true );
+		QObject::connect( close, SIGNAL(clicked()), editor, SLOT(onFindClose()) );
+		hbox->addWidget( close );
+
+		// only shown by Editor::handleReplace()
+		d_replaceRow = new QWidget( this );
+		vbox->addWidget( d_replaceRow );
+		hbox = new QHBoxLayout( d_replaceRow );
+		hbox->setMargin( 0 );
+		hbox->addWidget( new QLabel( Editor::tr("Replace:"), d_replaceRow ) );
+		d_replace = new QLineEdit( d_replaceRow );
+		QObject::connect( d_replace, SIGNAL(returnPressed()), editor, SLOT(onReplace()) );
+		hbox->addWidget( d_replace, 1 );
+		QToolButton* replace = new QToolButton( d_replaceRow );
+		replace->setText( Editor::tr("Replace") );
+		QObject::connect( replace, SIGNAL(clicked()), editor, SLOT(onReplace()) );
+		hbox->addWidget( replace );
+		QToolButton* all = new QToolButton( d_replaceRow );
+		all->setText( Editor::tr("All") );
+		QObject::connect( all, SIGNAL(clicked()), editor, SLOT(onReplaceAll()) );
+		hbox->addWidget( all );
+		d_replaceRow->hide();
+		QShortcut* esc = new QShortcut( Qt::Key_Escape, this );
+		esc->setContext( Qt::WidgetWithChildrenShortcut );
+		QObject::connect( esc, SIGNAL(activated()), editor, SLOT(onFindClose()) );
+	}
+};
+
+class _FindMarks : public QWidget
+{
+public:
+	// lies on top of the scroll bar and follows its size
+	_FindMarks(Editor* editor):QWidget(editor->verticalScrollBar()),d_codeEditor(editor)
+	{
+		setAttribute( Qt::WA_TransparentForMouseEvents );
+		parentWidget()->installEventFilter( this );
+		setGeometry( parentWidget()->rect() );
+	}
+protected:
+	bool eventFilter(QObject* watched, QEvent* event)
+	{
+		if( watched == parentWidget() && event->type() == QEvent::Resize )
+			setGeometry( parentWidget()->rect() );
+		return false;
+	}
+	void paintEvent(QPaintEvent *event)
+	{
+		d_codeEditor->paintFindMarks(event);
+	}
+private:
+	Editor* d_codeEditor;
+};
 }
 using namespace Ada;
 
 Editor::Editor(QWidget *parent) :
 	QPlainTextEdit(parent), d_showNumbers(true),
-    d_undoAvail(false),d_redoAvail(false),d_copyAvail(false),d_curPos(-1)
+    d_undoAvail(false),d_redoAvail(false),d_copyAvail(false),d_curPos(-1),d_cache(0),d_findSnapshot(0),d_finderSnapshot(-1),d_countSnapshot(-1),d_findCase(false),d_findTokens(0),d_findHitsValid(false),d_replacePending(false),d_findBar(0),d_findMarks(0),d_findBlocks(0)
 {
 	setFont( defaultFont() );
     setLineWrapMode( QPlainTextEdit::NoWrap );
@@ -129,6 +219,11 @@ Editor::Editor(QWidget *parent) :
     setTabChangesFocus(false);
 
     d_numberArea = new _HandleArea(this);
+	d_findBar = new _FindBar(this);
+	d_findBar->hide();
+	d_findMarks = new _FindMarks(this);
+	d_findRefresh.setSingleShot( true );
+	d_findRefresh.setInterval( 200 );
 
     connect(this, SIGNAL(blockCountChanged(int)), this, SLOT(updateLineNumberAreaWidth()));
     connect(this, SIGNAL(updateRequest(QRect,int)), this, SLOT(updateLineNumberArea(QRect,int)));
@@ -141,15 +236,30 @@ Editor::Editor(QWidget *parent) :
     updateLineNumberAreaWidth();
     highlightCurrentLine();
 
-	new Highlighter( document() );
+	d_hl = new Highlighter( document() );
+	connect( verticalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(updateVisibleBlocks()) );
+	connect( verticalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(updateFindSelections()) );
+	connect( document(), SIGNAL(contentsChange(int,int,int)), this, SLOT(onFindTextChange(int,int,int)) );
+	connect( this, SIGNAL(textChanged()), &d_findRefresh, SLOT(start()) );
+	connect( &d_findRefresh, SIGNAL(timeout()), this, SLOT(onFindRefresh()) );
+	connect( &d_findWatcher, SIGNAL(finished()), this, SLOT(onFindCounted()) );
 	updateTabWidth();
 
 	QSettings set;
 	const bool showLineNumbers = set.value( "AdaEditor/ShowLineNumbers" ).toBool();
 	setShowNumbers( showLineNumbers );
+	d_findCase = set.value( "AdaEditor/FindCaseSensitive" ).toBool();
+	d_findTokens = set.value( "AdaEditor/FindTokens" ).toInt();
 	setFont( set.value( "AdaEditor/Font", QVariant::fromValue( font() ) ).value<QFont>() );
 }
 
+Editor::~Editor()
+{
+	// findAll() works on a copy of the snapshot, but refers to d_findGeneration
+	d_findGeneration.ref();
+	d_findWatcher.waitForFinished();
+}
+
 QFont Editor::defaultFont()
 {
 	QFont f;
@@ -207,18 +317,35 @@ void Editor::setCursorPosition(int line, int index)
     }
 }
 
+void Editor::setText(const QString& str)
+{
+	// only the visible blocks are highlighted right away, the rest in the background
+	d_hl->beginProgressive();
+	setPlainText( str );
+	updateVisibleBlocks();
+}
+
+void Editor::updateVisibleBlocks()
+{
+	if( !d_hl->isProgressive() )
+		return;
+	// no line wrap, so each block is one line
+	const int first = firstVisibleBlock().blockNumber();
+	d_hl->setVisibleBlocks( first, first + viewport()->height() / qMax( 1, fontMetrics().lineSpacing() ) + 1 );
+}
+
 int Editor::getTokenTypeAtCursor() const
 {
     const QTextCursor cur = textCursor();
     const QTextBlock block = cur.block();
     const int pos = cur.selectionStart() - block.position();
-    QList<QTextLayout::FormatRange> fmts = block.layout()->additionalFormats();
-    foreach( const QTextLayout::FormatRange& f, fmts )
-    {
-        if( pos >= f.start && pos < f.start + f.length )
-			return f.format.intProperty(Highlighter::TokenProp);
-    }
-    return 0;
+	const BlockData* data = BlockData::get( block );
+	if( data == 0 )
+		return 0; // not yet highlighted
+	const int i = data->findToken( pos );
+	if( i < 0 )
+		return 0;
+	return data->getType( i );
 }
 
 QString Editor::textLine(int i) const
@@ -314,7 +441,21 @@ QString Editor::selectedText() const
 
 void Editor::updateLineNumberAreaWidth()
 {
-    setViewportMargins( handleAreaWidth(), 0, 0, 0);
+	// also called by the FontChange of setFont() before the find bar exists
+	const bool bar = d_findBar != 0 && !d_findBar->isHidden();
+    setViewportMargins( handleAreaWidth(), 0, 0, ( bar ) ? d_findBar->sizeHint().height() : 0 );
+	if( bar )
+		layoutFindBar();
+}
+
+void Editor::layoutFindBar()
+{
+	if( d_findBar == 0 || d_findBar->isHidden() )
+		return;
+	// below the viewport, which is narrowed by the bottom margin
+	const QRect vr = viewport()->geometry();
+	QRect cr = contentsRect();
+	d_findBar->setGeometry( QRect( cr.left(), vr.bottom() + 1, cr.width(), d_findBar->sizeHint().height() ) );
 }
 
 void Editor::updateLineNumberArea(const QRect &rect, int dy)
@@ -377,13 +518,29 @@ void Editor::handleEditSelectAll()
 void Editor::handleFind()
 {
 	ENABLED_IF( true );
-	bool ok	= FALSE;
-	QString res = QInputDialog::getText( this, tr("Find Text"),
-		tr("Enter a string to look for:"), QLineEdit::Normal, "", &ok );
-	if( !ok )
-		return;
-	d_find = res.toLatin1();
-	find( true );
+	showFindBar( false );
+}
+
+void Editor::showFindBar(bool replace)
+{
+	d_findBar->d_replaceRow->setVisible( replace );
+	if( d_findBar->isHidden() )
+	{
+		d_findBar->show();
+		// the only copy of the whole text; onFindTextChange() applies the edits to it
+		d_findText = toPlainText();
+		d_findSnapshot++;
+		d_findToks = TokenStore();
+		updatePattern();
+		findChanged();
+	}
+	updateLineNumberAreaWidth(); // the height depends on the replace row
+	QTextCursor cur = textCursor();
+	if( cur.hasSelection() && !cur.selectedText().contains( QChar::ParagraphSeparator ) )
+		d_findBar->d_edit->setText( cur.selectedText() );
+	d_findBar->d_edit->selectAll();
+	d_findBar->d_edit->setFocus();
+	updateFindSelections();
 }
 
 void Editor::handleFindAgain()
@@ -392,9 +549,205 @@ void Editor::handleFindAgain()
 	find( false );
 }
 
+void Editor::onFindNext()
+{
+	if( !d_find.isEmpty() )
+		find( false );
+}
+
+void Editor::onFindEdited(const QString& str)
+{
+	// searched as typed; the current hit is kept while it still matches
+	d_find = str;
+	d_replacePending = false;
+	updatePattern();
+	findChanged();
+	if( !d_find.isEmpty() )
+		findFrom( textCursor().selectionStart() );
+	updateFindSelections();
+}
+
+void Editor::onFindClose()
+{
+	d_findBar->hide();
+	d_findGeneration.ref(); // cancels the count
+	d_replacePending = false;
+	d_findText = QString();
+	d_finder = FindEngine();
+	d_finderSnapshot = -1;
+	d_findToks = TokenStore();
+	d_findHitsValid = false;
+	d_findLines.clear();
+	d_findMarks->update();
+	updateLineNumberAreaWidth();
+	updateFindSelections();
+	setFocus();
+}
+
+void Editor::onFindRefresh()
+{
+	if( d_findBar->isHidden() )
+		return;
+	if( d_countSnapshot != d_findSnapshot )
+		findChanged(); // the text was edited since the count started
+	updateFindSelections();
+}
+
+void Editor::handleFindCase()
+{
+	CHECKED_IF( true, d_findCase );
+
+	d_findCase = !d_findCase;
+	d_replacePending = false;
+	QSettings set;
+	set.setValue( "AdaEditor/FindCaseSensitive", d_findCase );
+	updatePattern();
+	findChanged();
+	updateFindSelections();
+}
+
+void Editor::setFindTokens(int kinds)
+{
+	d_findTokens = kinds;
+	d_replacePending = false;
+	QSettings set;
+	set.setValue( "AdaEditor/FindTokens", kinds );
+	updatePattern();
+	findChanged();
+	updateFindSelections();
+}
+
+void Editor::handleFindIdents()
+{
+	CHECKED_IF( true, d_findTokens & FindIdents );
+
+	setFindTokens( d_findTokens ^ FindIdents );
+}
+
+void Editor::handleFindAttrs()
+{
+	CHECKED_IF( true, d_findTokens & FindAttrs );
+
+	setFindTokens( d_findTokens ^ FindAttrs );
+}
+
+void Editor::handleFindKeyWords()
+{
+	CHECKED_IF( true, d_findTokens & FindKeyWords );
+
+	setFindTokens( d_findTokens ^ FindKeyWords );
+}
+
 void Editor::handleReplace()
 {
-	// TODO
+	ENABLED_IF( !isReadOnly() );
+	showFindBar( true );
+}
+
+bool Editor::isHitAt(int pos) const
+{
+	// in the current text, which may be newer than the snapshot
+	const QTextBlock b = document()->findBlock( pos );
+	QVector<int> cols;
+	d_matcher.findIn( b.text(), cols );
+	const int col = pos - b.position();
+	if( !cols.contains( col ) )
+		return false;
+	return d_findTokens == 0 || isTokenHit( b.blockNumber(), col, d_matcher.getPatternLength() );
+}
+
+void Editor::onReplace()
+{
+	if( d_find.isEmpty() || isReadOnly() )
+		return;
+	// the selection is only replaced if it is a hit, e.g. selected by find again
+	QTextCursor cur = textCursor();
+	if( cur.hasSelection() && cur.selectionEnd() - cur.selectionStart() == d_matcher.getPatternLength() &&
+			isHitAt( cur.selectionStart() ) )
+	{
+		cur.insertText( d_findBar->d_replace->text() );
+		setTextCursor( cur );
+	}
+	findFrom( cur.position() );
+	updateFindSelections();
+}
+
+struct _ReplaceRange
+{
+	int d_from;
+	int d_to;
+	QString d_text; // replaces the text from d_from to d_to
+};
+
+void Editor::onReplaceAll()
+{
+	if( d_find.isEmpty() || isReadOnly() )
+		return;
+	if( !d_findHitsValid || d_finderSnapshot != d_findSnapshot )
+	{
+		// the hits are found by the count in the background; onFindCounted() calls this again
+		d_replacePending = true;
+		if( d_countSnapshot != d_findSnapshot )
+			findChanged();
+		else if( !d_findWatcher.isRunning() )
+			startFindCount();
+		return;
+	}
+	const QString& text = d_finder.getText();
+	const int len = d_finder.getPatternLength();
+	const QVector<int> hits = d_findHits;
+	if( hits.isEmpty() )
+		return;
+
+	// The new text of the changed lines is made in one pass over the hits, one range per line with
+	// hits; the lines in between stay untouched, so the Highlighter keeps their tokens.
+	QList<_ReplaceRange> ranges;
+	const QString with = d_findBar->d_replace->text();
+	int lastLine = -1;
+	int copied = 0; // offset in text up to which the current range is built
+	for( int i = 0; i < hits.size(); i++ )
+	{
+		if( hits[i] < copied )
+			continue; // overlaps the hit before, e.g. "aa" in "aaa"
+		const int line = d_finder.findBlock( hits[i] );
+		if( line != lastLine )
+		{
+			if( !ranges.isEmpty() )
+			{
+				// the old range ends with its last line
+				_ReplaceRange& r = ranges.last();
+				r.d_to = ( lastLine + 1 < d_finder.getBlockCount() ) ?
+							d_finder.getBlockStart( lastLine + 1 ) - 1 : text.size();
+				r.d_text.append( text.midRef( copied, r.d_to - copied ) );
+			}
+			_ReplaceRange r;
+			r.d_from = d_finder.getBlockStart( line );
+			r.d_to = -1;
+			ranges.append( r );
+			copied = r.d_from;
+		}
+		_ReplaceRange& r = ranges.last();
+		r.d_text.append( text.midRef( copied, hits[i] - copied ) );
+		r.d_text.append( with );
+		copied = hits[i] + len;
+		lastLine = line; // the pattern has no line breaks
+	}
+	_ReplaceRange& r = ranges.last();
+	r.d_to = ( lastLine + 1 < d_finder.getBlockCount() ) ? d_finder.getBlockStart( lastLine + 1 ) - 1 : text.size();
+	r.d_text.append( text.midRef( copied, r.d_to - copied ) );
+
+	// One undo step; applied from the end, so the offsets of the snapshot stay valid. QTextDocument
+	// reports the edit block as one change when it ends.
+	QTextCursor cur( document() );
+	cur.beginEditBlock();
+	for( int i = ranges.size() - 1; i >= 0; i-- )
+	{
+		cur.setPosition( ranges[i].d_from );
+		cur.setPosition( ranges[i].d_to, QTextCursor::KeepAnchor );
+		cur.insertText( ranges[i].d_text );
+	}
+	cur.endEditBlock();
+	updateFindSelections();
 }
 
 void Editor::handleGoto()
@@ -437,36 +790,311 @@ void Editor::handleSetIndent()
 		setIndentation( level );
 }
 
-void Editor::find(bool fromTop)
+void Editor::updatePattern()
 {
-	int line, col;
-	getCursorPosition( &line, &col );
-	if( fromTop )
+	// identifiers and keywords are case insensitive anyway
+	d_matcher.setPattern( d_find, d_findCase && d_findTokens == 0 );
+}
+
+void Editor::onFindTextChange(int pos, int removed, int added)
+{
+	if( d_findText.isNull() )
+		return; // the find bar is closed
+	if( pos > d_findText.size() )
+		pos = d_findText.size(); // not expected; repaired below
+	// The mirror of the text only gets the changed part. The highlighter reports unchanged blocks
+	// when it sets their formats, and the document may count its last separator.
+	const int rem = qMin( removed, d_findText.size() - pos );
+	QTextCursor cur( document() );
+	cur.setPosition( pos );
+	cur.setPosition( qMin( pos + added, document()->characterCount() - 1 ), QTextCursor::KeepAnchor );
+	QString text = cur.selectedText();
+	for( int i = 0; i < text.size(); i++ )
+	{
+		// as QTextDocument::toPlainText()
+		const ushort ch = text[i].unicode();
+		if( ch == QChar::ParagraphSeparator || ch == QChar::LineSeparator || ch == 0xfdd0 || ch == 0xfdd1 )
+			text[i] = QLatin1Char('\n');
+		else if( ch == QChar::Nbsp )
+			text[i] = QLatin1Char(' ');
+	}
+	if( rem == text.size() && d_findText.midRef( pos, rem ) == text )
+		return;
+	d_findText.replace( pos, rem, text );
+	if( d_findText.size() != document()->characterCount() - 1 )
+		d_findText = toPlainText(); // not expected
+	d_findSnapshot++;
+	d_findToks = TokenStore();
+}
+
+void Editor::findChanged()
+{
+	d_findHitsValid = false;
+	startFindCount();
+}
+
+static const int s_findChunk = 256 * 1024; // chars searched by findAll() between two checks of the generation
+
+static inline bool _isTokenKind( quint8 type, int kinds )
+{
+	if( type == LexerCore::T_Identifier )
+		return kinds & Editor::FindIdents;
+	else if( type == LexerCore::T_Attribute )
+		return kinds & Editor::FindAttrs;
+	else if( LexerCore::isKeyWord( type ) )
+		return kinds & Editor::FindKeyWords;
+	else
+		return false;
+}
+
+bool Editor::isTokenHit(int line, int col, int len) const
+{
+	// the tokens of the block are taken from the highlighter, or lexed if not highlighted yet
+	const QTextBlock b = document()->findBlockByNumber( line );
+	const BlockData* data = BlockData::get( b );
+	quint8 type;
+	if( data != 0 && b.userState() != -1 )
 	{
-		line = 0;
-		col = 0;
+		const int i = data->findToken( col );
+		if( i == -1 || data->getCol( i ) != quint32( col ) || data->getLength( i ) != quint32( len ) )
+			return false;
+		type = data->getType( i );
 	}else
-		col++;
-	const int count = lineCount();
-	int j = -1;
-	for( int i = qMax(line,0); i < count; i++ )
 	{
-		j = textLine( i ).indexOf( d_find, col );
-		if( j != -1 )
+		const QString text = b.text();
+		const int prev = b.previous().userState();
+		LexerCore lex;
+		lex.setBuffer( text.constData(), text.constData() + text.size() );
+		lex.setState( ( prev == -1 ) ? 0 : prev );
+		LexerCore::Token t = lex.nextToken();
+		while( !t.isEof() && t.d_col < quint32( col ) )
+			t = lex.nextToken();
+		if( t.isEof() || t.d_col != quint32( col ) || t.d_len != quint32( len ) )
+			return false;
+		type = t.d_type;
+	}
+	return _isTokenKind( type, d_findTokens );
+}
+
+int Editor::findInBlocks(int from) const
+{
+	// until the count delivered the hits, the blocks are searched from the one of from, wrapping
+	// around; in the current text, so the snapshot is not needed
+	const QTextBlock start = document()->findBlock( from );
+	QTextBlock b = start;
+	QVector<int> cols;
+	const int len = d_matcher.getPatternLength();
+	for( int pass = 0; pass < 2; pass++ )
+	{
+		while( b.isValid() )
 		{
-			line = i;
-			col = j;
+			d_matcher.findIn( b.text(), cols );
+			for( int i = 0; i < cols.size(); i++ )
+			{
+				const int hit = b.position() + cols[i];
+				if( ( pass == 0 && hit < from ) || ( pass == 1 && hit >= from ) )
+					continue;
+				if( d_findTokens == 0 || isTokenHit( b.blockNumber(), cols[i], len ) )
+					return hit;
+			}
+			if( pass == 1 && b == start )
+				return -1;
+			b = b.next();
+		}
+		b = document()->begin();
+	}
+	return -1;
+}
+
+Editor::FindResult Editor::findAll(const FindTask& task, QAtomicInt* current)
+{
+	// runs in a worker thread; returns early as soon as the generation is obsolete
+	const int generation = task.d_generation;
+	FindResult res;
+	res.d_generation = generation;
+	res.d_snapshot = task.d_snapshot;
+	res.d_finder = task.d_finder;
+	FindEngine& finder = res.d_finder;
+	if( finder.getBlockCount() == 0 )
+		finder.setText( task.d_text ); // once per snapshot, like the folded text made by find()
+	res.d_tokens = task.d_tokens;
+	const int tokens = task.d_kinds;
+	if( tokens != 0 && res.d_tokens.isEmpty() )
+	{
+		// once per snapshot, in chunks on all cores; kept even if the generation is obsolete
+		Highlighter::DocTokens* doc = Highlighter::tokenize( finder.getText(), 0 );
+		res.d_tokens = doc->d_tokens;
+		delete doc;
+	}
+	const TokenStore& store = res.d_tokens;
+	const int len = finder.getPatternLength();
+	const int n = finder.getText().size();
+	// the generation is checked after each chunk, however few hits there are
+	for( int start = 0; start < n; start += s_findChunk )
+	{
+		if( int( *current ) != generation )
 			break;
-		}else if( i < count )
-			col = 0;
+		const int end = qMin( n, start + s_findChunk + len - 1 ); // hits starting in the chunk
+		int from = start;
+		forever
+		{
+			const int hit = finder.find( from, false, end );
+			if( hit == -1 )
+				break;
+			from = hit + 1;
+			if( tokens != 0 )
+			{
+				const int i = store.findToken( hit );
+				if( i == -1 || store.getOffset( i ) != quint32( hit ) || store.getLength( i ) != quint32( len ) ||
+						!_isTokenKind( store.getType( i ), tokens ) )
+					continue;
+			}
+			res.d_hits.append( hit );
+			const int line = finder.findBlock( hit );
+			if( res.d_lines.isEmpty() || res.d_lines.last() != line )
+				res.d_lines.append( line );
+		}
+	}
+	return res;
+}
+
+Editor::FindTask Editor::findTask() const
+{
+	FindTask task;
+	// the engine with the block starts and the folded text is reused while the text is unchanged
+	if( d_finderSnapshot == d_findSnapshot )
+		task.d_finder = d_finder;
+	task.d_finder.setPattern( d_find, d_findCase && d_findTokens == 0 );
+	task.d_text = d_findText; // implicitly shared, so only copied by the next edit
+	task.d_tokens = d_findToks;
+	task.d_kinds = d_findTokens;
+	task.d_snapshot = d_findSnapshot;
+	task.d_generation = d_findGeneration;
+	return task;
+}
+
+void Editor::startFindCount()
+{
+	d_findGeneration.ref();
+	d_findLines.clear();
+	d_findMarks->update();
+	d_findBar->d_count->setText( d_find.isEmpty() ? QString() : tr("counting...") );
+	if( d_find.isEmpty() || d_findBar->isHidden() || d_findWatcher.isRunning() )
+		return; // onFindCounted() starts again for the current generation
+	runFindCount();
+}
+
+void Editor::runFindCount()
+{
+	d_countSnapshot = d_findSnapshot;
+	d_findWatcher.setFuture( QtConcurrent::run( findAll, findTask(), &d_findGeneration ) );
+}
+
+void Editor::onFindCounted()
+{
+	const FindResult res = d_findWatcher.result();
+	if( res.d_snapshot == d_findSnapshot )
+	{
+		// the text is only split, folded and lexed once, even if the generation is obsolete
+		d_finder = res.d_finder;
+		d_finderSnapshot = res.d_snapshot;
+		if( d_findToks.isEmpty() )
+			d_findToks = res.d_tokens;
+	}
+	if( res.d_generation != int( d_findGeneration ) )
+	{
+		// the pattern or the document changed meanwhile
+		if( !d_find.isEmpty() && !d_findBar->isHidden() )
+			runFindCount();
+		return;
 	}
-	if( j != -1 )
+	d_finder = res.d_finder;
+	d_finderSnapshot = res.d_snapshot;
+	d_findHits = res.d_hits;
+	d_findHitsValid = true;
+	d_findLines = res.d_lines;
+	d_findBlocks = d_finder.getBlockCount();
+	d_findMarks->update();
+	d_findBar->d_count->setText( tr("%1 matches").arg( res.d_hits.size() ) );
+	if( d_replacePending )
 	{
-		setCursorPosition( line, col + d_find.size() );
-		ensureLineVisible( line );
-		setSelection( line, col, line, col + d_find.size() );
+		d_replacePending = false;
+		onReplaceAll();
 	}
+}
 
+void Editor::paintFindMarks(QPaintEvent*)
+{
+	if( d_findLines.isEmpty() )
+		return;
+	QPainter painter( d_findMarks );
+	// the arrow buttons are assumed to be square
+	const int w = d_findMarks->width();
+	const int h = d_findMarks->height() - 2 * w;
+	const int blocks = qMax( 1, d_findBlocks );
+	int lastY = -1;
+	for( int i = 0; i < d_findLines.size(); i++ )
+	{
+		const int y = w + qint64( d_findLines[i] ) * h / blocks;
+		if( y == lastY )
+			continue;
+		lastY = y;
+		painter.fillRect( 2, y, w - 4, 2, QColor(255,140,0) );
+	}
+}
+
+void Editor::updateFindSelections()
+{
+	// only the hits in the blocks of the viewport are searched and shown
+	d_findSelections.clear();
+	if( !d_findBar->isHidden() && !d_find.isEmpty() )
+	{
+		const int lines = viewport()->height() / qMax( 1, fontMetrics().lineSpacing() ) + 1;
+		const int len = d_matcher.getPatternLength();
+		QTextEdit::ExtraSelection sel;
+		sel.format.setBackground( QColor(255,200,0) );
+		QVector<int> cols;
+		QTextBlock b = firstVisibleBlock();
+		for( int n = 0; b.isValid() && n <= lines; n++, b = b.next() )
+		{
+			d_matcher.findIn( b.text(), cols );
+			for( int i = 0; i < cols.size(); i++ )
+			{
+				if( d_findTokens != 0 && !isTokenHit( b.blockNumber(), cols[i], len ) )
+					continue;
+				sel.cursor = QTextCursor( document() );
+				sel.cursor.setPosition( b.position() + cols[i] );
+				sel.cursor.setPosition( b.position() + cols[i] + len, QTextCursor::KeepAnchor );
+				d_findSelections.append( sel );
+			}
+		}
+	}
+	highlightCurrentLine();
+}
+
+void Editor::find(bool fromTop)
+{
+	findFrom( fromTop ? 0 : textCursor().selectionStart() + 1 );
+}
+
+void Editor::findFrom(int from)
+{
+	int hit = -1;
+	if( d_findHitsValid && d_finderSnapshot == d_findSnapshot )
+	{
+		if( d_findHits.isEmpty() )
+			return;
+		const int i = qLowerBound( d_findHits.begin(), d_findHits.end(), from ) - d_findHits.begin();
+		hit = d_findHits[ ( i < d_findHits.size() ) ? i : 0 ]; // wraps around
+	}else
+		hit = findInBlocks( from );
+	if( hit == -1 )
+		return;
+	const QTextBlock b = document()->findBlock( hit );
+	const int line = b.blockNumber();
+	const int col = hit - b.position();
+	ensureLineVisible( line );
+	setSelection( line, col, line, col + d_matcher.getPatternLength() );
 }
 
 void Editor::handlePrint()
@@ -546,7 +1174,9 @@ void Editor::resizeEvent(QResizeEvent *e)
     QPlainTextEdit::resizeEvent(e);
 
     QRect cr = contentsRect();
-    d_numberArea->setGeometry(QRect(cr.left(), cr.top(), handleAreaWidth(), cr.height()));
+    d_numberArea->setGeometry(QRect(cr.left(), cr.top(), handleAreaWidth(), viewport()->height()));
+	layoutFindBar();
+	updateFindSelections();
 }
 
 void Editor::paintEvent(QPaintEvent *e)
@@ -691,6 +1321,7 @@ void Editor::highlightCurrentLine()
     selection.cursor = textCursor();
     selection.cursor.clearSelection();
     extraSelections.append(selection);
+	extraSelections += d_findSelections;
 
     setExtraSelections(extraSelections);
 }
@@ -834,7 +1465,10 @@ bool Editor::loadFromFile(const QString &filename)
     QFile file(filename);
     if( !file.open(QIODevice::ReadOnly ) )
         return false;
-	setText( QString::fromLatin1( file.readAll() ) );
+	const QByteArray bytes = file.readAll();
+	setText( QString::fromLatin1( bytes ) );
+	if( d_cache )
+		d_hl->setCache( d_cache, TokenCache::Key( filename, bytes ) );
 	// TODO: laut Gnat sind Ada-Sourcen in Latin-1; unklar, was man sonst macht.
     document()->setModified( false );
 	emit updateCaption(filename);
@@ -881,7 +1515,11 @@ void Editor::installDefaultPopup()
 	pop->addSeparator();
 	pop->addCommand( "Find...", this, SLOT(handleFind()), tr("CTRL+F"), true );
 	pop->addCommand( "Find again", this, SLOT(handleFindAgain()), tr("F3"), true );
-	//pop->addCommand( "Replace...", this, SLOT(handleReplace()), tr("CTRL+R"), true );
+	pop->addCommand( "Match Case", this, SLOT(handleFindCase()) );
+	pop->addCommand( "Find in Identifiers", this, SLOT(handleFindIdents()) );
+	pop->addCommand( "Find in Attributes", this, SLOT(handleFindAttrs()) );
+	pop->addCommand( "Find in Keywords", this, SLOT(handleFindKeyWords()) );
+	pop->addCommand( "Replace...", this, SLOT(handleReplace()), tr("CTRL+R"), true );
 	pop->addCommand( "&Goto...", this, SLOT(handleGoto()), tr("CTRL+G"), true );
 	pop->addCommand( "Show &Linenumbers", this, SLOT(handleShowLinenumbers()) );
 //	pop->addSeparator();
@@ -22,19 +22,31 @@
 
 #include <QPlainTextEdit>
 #include <QSet>
+#include <QTimer>
+#include <QFutureWatcher>
+#include <QAtomicInt>
+#include "AdaFindEngine.h"
+#include "AdaTokenStore.h"
 
 // adaptiert aus Lua::CodeEditor
 
 namespace Ada
 {
+	class Highlighter;
+	class TokenCache;
+	class _FindBar;
+
 	class Editor : public QPlainTextEdit
     {
         Q_OBJECT
     public:
+		enum FindTokens { FindIdents = 1, FindAttrs = 2, FindKeyWords = 4 }; // else the text is searched
 		explicit Editor(QWidget *parent = 0);
+		~Editor();
 		static QFont defaultFont();
 
         void paintHandleArea(QPaintEvent *event);
+		void paintFindMarks(QPaintEvent *event);
         int handleAreaWidth();
         int lineAt( const QPoint& ) const;
 
@@ -42,7 +54,7 @@ namespace Ada
         void setCursorPosition(int textLine,int index);
         int getTokenTypeAtCursor() const;
         QString textLine( int i ) const;
-        void setText( const QString& str ) { setPlainText( str ); }
+        void setText( const QString& str );
         QString text() const { return toPlainText(); }
 		QString getText() const { return toPlainText(); }
 		void setName( const QString& str );
@@ -65,6 +77,9 @@ namespace Ada
         bool showNumbers() const { return d_showNumbers; }
 		bool loadFromFile( const QString& filename );
 		bool loadFromString( const QString& source );
+		void setTokenCache( const TokenCache* c ) { d_cache = c; } // not owned; used by loadFromFile()
+		void setFindTokens( int ); // FindTokens
+		int getFindTokens() const { return d_findTokens; }
         void addBreakPoint( int );
         void removeBreakPoint( int );
         void clearBreakPoints();
@@ -81,6 +96,10 @@ namespace Ada
 		void handleEditSelectAll();
 		void handleFind();
 		void handleFindAgain();
+		void handleFindCase();
+		void handleFindIdents();
+		void handleFindAttrs();
+		void handleFindKeyWords();
 		void handleReplace();
 		void handleGoto();
 		void handleIndent();
@@ -100,6 +119,42 @@ namespace Ada
         void paintIndents( QPaintEvent *e );
         void updateTabWidth();
 		void find(bool fromTop);
+		void findFrom( int pos );
+		void updatePattern();
+		void findChanged();
+		bool isTokenHit( int line, int col, int len ) const;
+		int findInBlocks( int from ) const;
+		void layoutFindBar();
+		void showFindBar( bool replace );
+		bool isHitAt( int pos ) const;
+
+		// A snapshot of the document searched by a background task. The first task of a snapshot
+		// finds the block starts, folds the text if needed and, in token mode, lexes it;
+		// onFindCounted() keeps the engine and the tokens for the following ones.
+		struct FindTask
+		{
+			QString d_text;
+			FindEngine d_finder; // without text if not made yet
+			TokenStore d_tokens; // of the snapshot, empty if not lexed yet
+			int d_kinds;         // FindTokens, or 0 if the text is searched
+			int d_snapshot;
+			int d_generation;
+		};
+		// All hits of the snapshot, found by a background task; obsolete once d_findGeneration changed
+		struct FindResult
+		{
+			int d_generation;
+			int d_snapshot;
+			FindEngine d_finder;
+			TokenStore d_tokens;
+			QVector<int> d_hits;  // offsets
+			QVector<int> d_lines; // blocks with hits
+			FindResult():d_generation(0),d_snapshot(0) {}
+		};
+		static FindResult findAll( const FindTask&, QAtomicInt* current );
+		FindTask findTask() const;
+		void startFindCount();
+		void runFindCount();
         // To override
 		virtual void numberAreaDoubleClicked( int ) {}
     private slots:
@@ -110,16 +165,48 @@ namespace Ada
         void onRedoAvail(bool on) { d_redoAvail = on; }
         void onCopyAvail(bool on) { d_copyAvail = on; }
 		void onUpdateCursor();
+		void updateVisibleBlocks();
+		void updateFindSelections();
+		void onFindEdited( const QString& );
+		void onFindNext();
+		void onFindClose();
+		void onReplace();
+		void onReplaceAll();
+		void onFindCounted();
+		void onFindRefresh();
+		void onFindTextChange( int pos, int removed, int added );
 	private:
         QWidget* d_numberArea;
+		Highlighter* d_hl;
         QSet<int> d_breakPoints;
         int d_curPos; // Zeiger fr die aktuelle Ausfhrungsposition oder -1
 		QString d_find;
+		FindEngine d_matcher; // the pattern, for the blocks of the viewport and find again
+		QString d_findText;  // the text while the find bar is open, kept up to date by onFindTextChange()
+		int d_findSnapshot;  // counts the changes of d_findText
+		FindEngine d_finder; // of the last count, with the text of d_finderSnapshot
+		int d_finderSnapshot;
+		int d_countSnapshot; // of the count started last
+		TokenStore d_findToks; // of d_findText, made by findAll(); empty if not yet
+		bool d_findCase;
+		int d_findTokens;
+		QVector<int> d_findHits; // sorted offsets of the hits in d_finder, of the current generation
+		bool d_findHitsValid;
+		bool d_replacePending; // onReplaceAll() waits for d_findHits
+		_FindBar* d_findBar;
+		QWidget* d_findMarks; // on the vertical scroll bar
+		QList<QTextEdit::ExtraSelection> d_findSelections; // only the visible hits
+		QVector<int> d_findLines; // of FindResult
+		int d_findBlocks;
+		QFutureWatcher<FindResult> d_findWatcher;
+		QAtomicInt d_findGeneration;
+		QTimer d_findRefresh; // after edits while the find bar is open
 		QString d_name;
 		bool d_undoAvail;
         bool d_redoAvail;
         bool d_copyAvail;
         bool d_showNumbers;
+		const TokenCache* d_cache;
     };
 }
 
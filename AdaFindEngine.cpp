@@ -0,0 +1,148 @@
+/*
+* Copyright 2012-2017 Rochus Keller <mailto:me@rochus-keller.info>
+*
+* This file is part of the AdaViewer application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.info.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "AdaFindEngine.h"
+#include "AdaScanKernels.h"
+#include <QtAlgorithms>
+#include <string.h>
+using namespace Ada;
+
+FindEngine::FindEngine():d_caseSensitive(false)
+{
+	for( int i = 0; i < 256; i++ )
+		d_skip[i] = 1;
+}
+
+void FindEngine::setText(const QString& text)
+{
+	d_text = text;
+	d_folded.clear();
+	d_blockStarts.clear();
+	d_blockStarts.append( 0 );
+	const ushort* begin = d_text.utf16();
+	const ushort* end = begin + d_text.size();
+	const ushort* p = ScanKernels::findNewline( begin, end );
+	while( p < end )
+	{
+		d_blockStarts.append( p - begin + 1 );
+		p = ScanKernels::findNewline( p + 1, end );
+	}
+}
+
+ushort FindEngine::fold(ushort ch)
+{
+	if( ch < 128 )
+		return ( ch >= 'A' && ch <= 'Z' ) ? ch + ( 'a' - 'A' ) : ch;
+	else
+		return QChar( ch ).toCaseFolded().unicode(); // simple case folding, one code unit
+}
+
+void FindEngine::setPattern(const QString& pattern, bool caseSensitive)
+{
+	d_caseSensitive = caseSensitive;
+	d_pattern = pattern;
+	if( !caseSensitive )
+	{
+		for( int i = 0; i < d_pattern.size(); i++ )
+			d_pattern[i] = fold( d_pattern[i].unicode() );
+	}
+	const int m = d_pattern.size();
+	for( int i = 0; i < 256; i++ )
+		d_skip[i] = qMax( m, 1 );
+	const ushort* pat = d_pattern.utf16();
+	for( int i = 0; i < m - 1; i++ )
+		d_skip[ pat[i] & 0xff ] = m - 1 - i;
+}
+
+const ushort* FindEngine::haystack() const
+{
+	if( d_caseSensitive )
+		return d_text.utf16();
+	if( d_folded.size() != d_text.size() )
+	{
+		d_folded.resize( d_text.size() );
+		const ushort* s = d_text.utf16();
+		ushort* f = reinterpret_cast<ushort*>( d_folded.data() );
+		for( int i = 0; i < d_text.size(); i++ )
+			f[i] = fold( s[i] );
+	}
+	return d_folded.utf16();
+}
+
+int FindEngine::search(const ushort* text, int from, int to) const
+{
+	const int m = d_pattern.size();
+	const ushort* pat = d_pattern.utf16();
+	const ushort last = pat[m - 1];
+	const size_t rest = ( m - 1 ) * sizeof(ushort);
+	int i = from;
+	while( i + m <= to )
+	{
+		const ushort c = text[i + m - 1];
+		if( c == last && ::memcmp( text + i, pat, rest ) == 0 )
+			return i;
+		i += d_skip[ c & 0xff ];
+	}
+	return -1;
+}
+
+int FindEngine::find(int from, bool wrap, int to) const
+{
+	if( d_pattern.isEmpty() )
+		return -1;
+	const ushort* text = haystack();
+	const int n = ( to < 0 ) ? d_text.size() : qMin( to, d_text.size() );
+	from = qBound( 0, from, n );
+	int hit = search( text, from, n );
+	if( hit == -1 && wrap && from > 0 )
+		hit = search( text, 0, qMin( n, from + d_pattern.size() - 1 ) ); // hits starting before from
+	return hit;
+}
+
+void FindEngine::findIn(const QString& text, QVector<int>& hits) const
+{
+	hits.clear();
+	if( d_pattern.isEmpty() )
+		return;
+	QString folded;
+	const ushort* str = text.utf16();
+	if( !d_caseSensitive )
+	{
+		folded.resize( text.size() );
+		ushort* f = reinterpret_cast<ushort*>( folded.data() );
+		for( int i = 0; i < text.size(); i++ )
+			f[i] = fold( str[i] );
+		str = folded.utf16();
+	}
+	int from = 0;
+	forever
+	{
+		const int hit = search( str, from, text.size() );
+		if( hit == -1 )
+			break;
+		hits.append( hit );
+		from = hit + 1;
+	}
+}
+
+int FindEngine::findBlock(int off) const
+{
+	const int* begin = d_blockStarts.constData();
+	return qUpperBound( begin, begin + d_blockStarts.size(), off ) - begin - 1;
+}
@@ -0,0 +1,61 @@
+#ifndef ADAFINDENGINE_H
+#define ADAFINDENGINE_H
+
+/*
+* Copyright 2012-2017 Rochus Keller <mailto:me@rochus-keller.info>
+*
+* This file is part of the AdaViewer application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.info.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <QString>
+#include <QVector>
+
+namespace Ada
+{
+	// Text search in a snapshot of a whole document with Boyer-Moore-Horspool. Case insensitive
+	// search compares case folded text like Ada does for identifiers; the folded copy of the snapshot
+	// is made once. Hits are offsets in the snapshot; block and column are found by binary search.
+	class FindEngine
+	{
+	public:
+		FindEngine();
+		void setText( const QString& ); // blocks separated by '\n', as from QTextDocument::toPlainText()
+		const QString& getText() const { return d_text; }
+		void setPattern( const QString&, bool caseSensitive = false );
+		int getPatternLength() const { return d_pattern.size(); }
+		// offset of the first hit at or after from which ends before to (-1 for the end of the text),
+		// continued at the start if wrap; -1 if none
+		int find( int from, bool wrap = true, int to = -1 ) const;
+		// offsets of all hits in a short text, e.g. a block, which is not kept; hits may overlap
+		void findIn( const QString& text, QVector<int>& hits ) const;
+		int getBlockCount() const { return d_blockStarts.size(); }
+		int getBlockStart( int block ) const { return d_blockStarts[block]; }
+		int findBlock( int off ) const;
+		static ushort fold( ushort ch );
+	protected:
+		const ushort* haystack() const;
+		int search( const ushort* text, int from, int to ) const; // hit starting in [from, to - length]
+	private:
+		QString d_text;
+		mutable QString d_folded; // made by the first case insensitive search
+		QVector<int> d_blockStarts;
+		QString d_pattern; // folded unless d_caseSensitive
+		bool d_caseSensitive;
+		int d_skip[256]; // shift by the low byte of the last character of the window
+	};
+}
+
+#endif // ADAFINDENGINE_H
@@ -0,0 +1,37 @@
+QT       += core gui
+
+TARGET = AdaHighlightBench
+CONFIG   += console
+CONFIG   -= app_bundle
+TEMPLATE = app
+
+DEFINES += ADA_BENCH_HIGHLIGHT
+
+	DESTDIR = ./tmp
+	OBJECTS_DIR = ./tmp-hlbench
+	MOC_DIR = ./tmp-hlbench
+	CONFIG(debug, debug|release) {
+		DESTDIR = ./tmp-dbg
+		OBJECTS_DIR = ./tmp-hlbench-dbg
+		MOC_DIR = ./tmp-hlbench-dbg
+		DEFINES += _DEBUG
+	}
+
+SOURCES += \
+    AdaLexerBench.cpp \
+    AdaLexer.cpp \
+    AdaByteLexer.cpp \
+    AdaTokenStore.cpp \
+    AdaScanKernels.cpp \
+    AdaHighlighter.cpp \
+    AdaDeclIndex.cpp \
+    AdaTokenCache.cpp
+
+HEADERS += \
+    AdaLexer.h \
+    AdaByteLexer.h \
+    AdaTokenStore.h \
+    AdaScanKernels.h \
+    AdaHighlighter.h \
+    AdaDeclIndex.h \
+    AdaTokenCache.h
@@ -19,28 +19,406 @@
 
 #include "AdaHighlighter.h"
 #include "AdaLexer.h"
-#include <QTextStream>
+#include <QTextDocument>
+#include <QElapsedTimer>
+#include <QtConcurrentRun>
+#include <QtConcurrentMap>
+#include <QThread>
 using namespace Ada;
 
+static const int s_sliceBudget = 20; // ms of highlighting per idle time slice
+
+int BlockData::findToken(quint32 col) const
+{
+	// first token starting after col, the one before may cover it
+	int lo = 0;
+	int hi = d_toks.size();
+	while( lo < hi )
+	{
+		const int mid = ( lo + hi ) / 2;
+		if( d_toks[mid].d_col <= col )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	const int i = lo - 1;
+	if( i >= 0 && col < d_toks[i].d_col + d_toks[i].d_len )
+		return i;
+	else
+		return -1;
+}
+
+BlockData::~BlockData()
+{
+	if( d_index )
+	{
+		d_index->remove( d_decls );
+		d_index->removeUser( this, d_names );
+	}
+}
+
+void BlockData::assign(const TokenStore& tokens, int from, int to, quint32 base)
+{
+	d_toks.resize( to - from );
+	for( int i = from; i < to; i++ )
+	{
+		Tok& t = d_toks[i - from];
+		t.d_col = tokens.getOffset( i ) - base;
+		t.d_len = tokens.getLength( i );
+		t.d_type = tokens.getType( i );
+	}
+	d_toks.squeeze();
+}
+
 Highlighter::Highlighter(QTextDocument *parent) :
-	QSyntaxHighlighter(parent)
-{
-	d_lex = new Lexer(this);
-
-	d_commentFormat.setForeground(Qt::darkGreen);
-	d_stringFormat.setForeground(Qt::darkRed);
-	d_charFormat = d_stringFormat;
-	d_charFormat.setFontWeight(QFont::Bold);
-	d_numberFormat.setForeground(Qt::red);
-	d_delimiterFormat.setForeground(QColor(Qt::darkBlue).lighter(140)); // Qt::darkYellow);
-	d_delimiterFormat.setFontWeight(QFont::Bold);
-	d_keyWordFormat.setForeground(Qt::darkBlue); // QColor(0x00,0x00,0x7f)); // dunkelblau
-	d_keyWordFormat.setFontWeight(QFont::Bold);
-	d_identFormat.setForeground(Qt::black);
-	d_attrFormat.setForeground(Qt::darkCyan); // braun QColor(128,64,0)
-	d_invalidFormat.setForeground( Qt::magenta );
-	d_invalidFormat.setUnderlineColor( Qt::red );
-	d_invalidFormat.setUnderlineStyle( QTextCharFormat::WaveUnderline );
+	QSyntaxHighlighter(parent),d_nextPos(0),d_visFirst(0),d_visLast(-1),d_forced(-1),d_progressive(false),d_doc(0),d_workerResult(false),
+	d_cache(0),d_cacheRevision(-1),d_index( new DeclIndex() )
+{
+	d_formats[C_Comment].setForeground(Qt::darkGreen);
+	d_formats[C_String].setForeground(Qt::darkRed);
+	d_formats[C_Number].setForeground(Qt::red);
+	d_formats[C_Delimiter].setForeground(QColor(Qt::darkBlue).lighter(140)); // Qt::darkYellow);
+	d_formats[C_Delimiter].setFontWeight(QFont::Bold);
+	d_formats[C_KeyWord].setForeground(Qt::darkBlue); // QColor(0x00,0x00,0x7f)); // dunkelblau
+	d_formats[C_KeyWord].setFontWeight(QFont::Bold);
+	d_formats[C_Ident].setForeground(Qt::black);
+	d_formats[C_Attr].setForeground(Qt::darkCyan); // braun QColor(128,64,0)
+	d_formats[C_Object].setForeground(QColor(0x40,0x40,0x80));
+	d_formats[C_Subprogram].setForeground(QColor(0x80,0x40,0x00));
+	d_formats[C_Package].setForeground(QColor(0x00,0x60,0x60));
+	d_formats[C_Package].setFontItalic(true);
+	d_formats[C_Type].setForeground(Qt::darkMagenta);
+	d_formats[C_Invalid].setForeground( Qt::magenta );
+	d_formats[C_Invalid].setUnderlineColor( Qt::red );
+	d_formats[C_Invalid].setUnderlineStyle( QTextCharFormat::WaveUnderline );
+
+	for( int type = 0; type <= LexerCore::T_EOF; type++ )
+	{
+		if( type == LexerCore::T_Comment )
+			d_category[type] = C_Comment;
+		else if( type == LexerCore::T_String || type == LexerCore::T_Character )
+			d_category[type] = C_String;
+		else if( LexerCore::isNumber( type ) )
+			d_category[type] = C_Number;
+		else if( LexerCore::isDelimiter( type ) )
+			d_category[type] = C_Delimiter;
+		else if( LexerCore::isKeyWord( type ) )
+			d_category[type] = C_KeyWord;
+		else if( type == LexerCore::T_Identifier )
+			d_category[type] = C_Ident;
+		else if( type == LexerCore::T_Attribute )
+			d_category[type] = C_Attr;
+		else
+			d_category[type] = C_Invalid;
+	}
+
+	d_timer.setInterval( 0 ); // runs when the event queue is empty
+	connect( &d_timer, SIGNAL(timeout()), this, SLOT(onSlice()) );
+	if( parent )
+		connect( parent, SIGNAL(contentsChange(int,int,int)), this, SLOT(onContentsChange(int,int,int)) );
+	connect( &d_worker, SIGNAL(finished()), this, SLOT(onTokenized()) );
+	d_recolor.setInterval( 0 );
+	d_recolor.setSingleShot( true );
+	connect( &d_recolor, SIGNAL(timeout()), this, SLOT(onRecolor()) );
+}
+
+Highlighter::~Highlighter()
+{
+	if( d_workerResult )
+	{
+		d_worker.waitForFinished();
+		delete d_worker.result();
+	}
+	dropTokens();
+}
+
+void Highlighter::beginProgressive()
+{
+	d_progressive = true;
+	d_nextPos = 0;
+	d_visFirst = 0;
+	d_visLast = -1;
+	d_cache = 0;
+	dropTokens();
+	d_index->clearChanges();
+	d_timer.start();
+	// the document is empty yet; the snapshot is taken when the slices start, i.e. after setPlainText()
+	QTimer::singleShot( 0, this, SLOT(onTokenized()) );
+}
+
+namespace Ada
+{
+	// Whole lines of a document, lexed by one thread as if no tick was before them
+	struct Chunk
+	{
+		const QChar* d_begin;
+		const QChar* d_end;
+		quint32 d_off;  // of d_begin in the document
+		int d_block;    // number of the first block
+		int d_blocks;   // number of blocks
+		TokenStore d_tokens; // offsets relative to d_begin, lines start with 1
+		QVector<int> d_blockStart;
+		QVector<quint8> d_states;
+	};
+}
+
+static void _lexChunk( Chunk& c )
+{
+	LexerCore lex;
+	lex.setBuffer( c.d_begin, c.d_end );
+	int block = 0; // next block to be started
+	bool tick = false;
+	LexerCore::Token t = lex.nextToken();
+	while( !t.isEof() )
+	{
+		while( block < int( t.d_line ) ) // lines start with 1
+		{
+			if( block > 0 )
+				c.d_states.append( tick );
+			c.d_blockStart.append( c.d_tokens.getCount() );
+			block++;
+		}
+		c.d_tokens.append( t );
+		if( t.d_type != LexerCore::T_Comment )
+			tick = t.d_type == LexerCore::T_Tick; // same as LexerCore::getState()
+		t = lex.nextToken();
+	}
+	while( block < c.d_blocks )
+	{
+		if( block > 0 )
+			c.d_states.append( tick );
+		c.d_blockStart.append( c.d_tokens.getCount() );
+		block++;
+	}
+	c.d_states.append( tick );
+	c.d_blockStart.append( c.d_tokens.getCount() );
+}
+
+Highlighter::DocTokens* Highlighter::tokenize(const QString& text, int revision)
+{
+	// Lexing is line-local except for a tick at the end of a line, so the document is split into
+	// chunks of whole lines which are lexed in parallel; a chunk after a line ending with a tick is
+	// lexed again line by line until its states agree with the ones of the parallel pass.
+	static const int s_minChunk = 64 * 1024; // chars
+	const int threads = qMax( 1, QThread::idealThreadCount() );
+	const int target = qMax( s_minChunk, text.size() / threads + 1 );
+	QList<Chunk> chunks;
+	const QChar* const doc = text.constData();
+	int start = 0;
+	int block = 0;
+	forever
+	{
+		int end = qMin( start + target, text.size() );
+		while( end < text.size() && doc[end - 1] != QLatin1Char('\n') )
+			end++;
+		Chunk c;
+		c.d_begin = doc + start;
+		c.d_end = doc + end;
+		c.d_off = start;
+		c.d_block = block;
+		c.d_blocks = 0;
+		for( const QChar* p = c.d_begin; p < c.d_end; p++ )
+			if( *p == QLatin1Char('\n') )
+				c.d_blocks++;
+		if( end == text.size() )
+			c.d_blocks++; // the last block has no newline
+		chunks.append( c );
+		block += c.d_blocks;
+		if( end == text.size() )
+			break;
+		start = end;
+	}
+	QtConcurrent::blockingMap( chunks, _lexChunk );
+
+	DocTokens* res = new DocTokens();
+	res->d_revision = revision;
+	int count = 0;
+	for( int k = 0; k < chunks.size(); k++ )
+		count += chunks[k].d_tokens.getCount();
+	res->d_tokens.reserve( count );
+	quint8 state = 0;
+	for( int k = 0; k < chunks.size(); k++ )
+	{
+		const Chunk& c = chunks[k];
+		int b = 0;
+		const QChar* line = c.d_begin;
+		// fix-up of the first lines, usually none
+		LexerCore lex;
+		TokenStore tokens;
+		while( b < c.d_blocks && state != ( b == 0 ? 0 : c.d_states[b - 1] ) )
+		{
+			const QChar* eol = line;
+			while( eol < c.d_end && *eol != QLatin1Char('\n') )
+				eol++;
+			lex.setBuffer( line, eol );
+			lex.setState( state );
+			lex.tokenize( tokens );
+			state = lex.getState();
+			res->d_tokens.append( tokens, 0, line - doc, c.d_block + b );
+			line = eol + 1;
+			b++;
+		}
+		if( b < c.d_blocks )
+		{
+			res->d_tokens.append( c.d_tokens, c.d_blockStart[b], c.d_off, c.d_block );
+			state = c.d_states.last();
+		}
+	}
+	return res;
+}
+
+Highlighter::DocTokens* Highlighter::tokenizeAndStore(const QString& text, int revision,
+													 const TokenCache* cache, const TokenCache::Key& key)
+{
+	DocTokens* res = tokenize( text, revision );
+	cache->store( key, res->d_tokens );
+	return res;
+}
+
+void Highlighter::setCache(const TokenCache* cache, const TokenCache::Key& key)
+{
+	DocTokens* doc = new DocTokens();
+	if( cache->load( key, doc->d_tokens ) )
+	{
+		dropTokens();
+		doc->d_revision = document()->revision();
+		d_doc = doc; // onTokenized() does not start the worker
+		return;
+	}
+	delete doc;
+	d_cache = cache;
+	d_cacheKey = key;
+	d_cacheRevision = document()->revision();
+}
+
+void Highlighter::startTokenizer()
+{
+	if( d_worker.isRunning() )
+		return; // onTokenized() starts a new one if the result is stale
+	d_workerResult = true;
+	if( d_cache != 0 && document()->revision() == d_cacheRevision )
+		d_worker.setFuture( QtConcurrent::run( tokenizeAndStore, document()->toPlainText(), document()->revision(),
+											   d_cache, d_cacheKey ) );
+	else
+		d_worker.setFuture( QtConcurrent::run( tokenize, document()->toPlainText(), document()->revision() ) );
+	d_cache = 0; // the key is only valid for the text as loaded
+}
+
+void Highlighter::dropTokens()
+{
+	delete d_doc;
+	d_doc = 0;
+}
+
+void Highlighter::relexTokens(int pos, int removed, int added)
+{
+	// Only the tokens around the edit are lexed again; the text is taken from the blocks starting
+	// with the one of the edit, more of them if the new tokens do not line up with the old ones yet.
+	const LexerCore::Edit edit( pos, removed, added );
+	const QTextBlock first = document()->findBlock( pos );
+	const QTextBlock last = document()->findBlock( pos + added );
+	int more = 2; // blocks after the edit
+	forever
+	{
+		QString text;
+		QTextBlock b = first;
+		int after = 0;
+		while( b.isValid() && after <= more )
+		{
+			text += b.text();
+			if( b.blockNumber() >= last.blockNumber() )
+				after++;
+			b = b.next();
+			if( b.isValid() )
+				text += QLatin1Char('\n');
+		}
+		const LexerCore::Delta d = LexerCore::relex( d_doc->d_tokens, edit, text.constData(),
+						text.constData() + text.size(), first.position(), first.blockNumber() + 1, !b.isValid() );
+		if( d.d_first != -1 )
+			break;
+		more *= 2;
+	}
+	d_doc->d_revision = document()->revision();
+}
+
+void Highlighter::onTokenized()
+{
+	if( sender() == &d_worker && d_workerResult )
+	{
+		d_workerResult = false;
+		DocTokens* res = d_worker.result();
+		if( d_progressive && res->d_revision == document()->revision() )
+		{
+			dropTokens();
+			d_doc = res;
+			return;
+		}
+		delete res; // stale
+	}
+	// the document was changed while the worker was running, or no worker ran yet
+	if( d_progressive && ( d_doc == 0 || d_doc->d_revision != document()->revision() ) )
+		startTokenizer();
+}
+
+void Highlighter::setVisibleBlocks(int first, int last)
+{
+	if( !d_progressive )
+		return;
+	d_visFirst = first;
+	d_visLast = last;
+}
+
+QTextBlock Highlighter::nextPending()
+{
+	while( d_visFirst <= d_visLast )
+	{
+		const QTextBlock b = document()->findBlockByNumber( d_visFirst++ );
+		if( !b.isValid() )
+			break;
+		if( b.userState() == -1 )
+			return b;
+	}
+	QTextBlock b = document()->findBlock( d_nextPos );
+	while( b.isValid() && b.userState() != -1 )
+		b = b.next();
+	if( b.isValid() )
+		d_nextPos = b.position() + b.length();
+	return b;
+}
+
+void Highlighter::onSlice()
+{
+	QElapsedTimer t;
+	t.start();
+	while( t.elapsed() < s_sliceBudget )
+	{
+		const QTextBlock b = nextPending();
+		if( !b.isValid() )
+		{
+			d_progressive = false;
+			d_timer.stop();
+			dropTokens();
+			if( d_index->hasChanges() )
+				d_recolor.start(); // names declared after they were used
+			return;
+		}
+		d_forced = b.blockNumber();
+		rehighlightBlock( b );
+		d_forced = -1;
+	}
+}
+
+void Highlighter::onContentsChange(int pos, int removed, int added)
+{
+	if( d_forced != -1 )
+		return; // caused by rehighlightBlock()
+	if( d_doc != 0 )
+		relexTokens( pos, removed, added );
+	if( !d_progressive && d_index->hasChanges() )
+		d_recolor.start(); // e.g. blocks with declarations were deleted
+	// blocks before the background pass may have been inserted by the edit
+	if( d_progressive && pos < d_nextPos )
+		d_nextPos = pos;
 }
 
 QString Highlighter::formatTokenType(quint8 t)
@@ -50,33 +428,183 @@ QString Highlighter::formatTokenType(quint8 t)
 
 void Highlighter::highlightBlock(const QString &text)
 {
-	QTextStream in( const_cast<QString*>( &text ), QIODevice::ReadOnly );
-	d_lex->setStream( &in );
-	Lexer::Token t = d_lex->nextToken();
-	while( !t.isEof() )
+	if( d_progressive && currentBlockState() == -1 && currentBlock().blockNumber() != d_forced )
+		return; // left to onSlice(); the state stays -1, so QSyntaxHighlighter does not continue with the next block
+	if( d_doc != 0 )
 	{
-		QTextCharFormat f;
-		if( t.isComment() )
-			f = d_commentFormat;
-		else if( t.isString() ) // d_type == Lexer::T_String )
-			f = d_stringFormat;
-		else if( t.d_type == Lexer::T_Character )
-			f = d_charFormat;
-		else if( t.isNumber() )
-			f = d_numberFormat;
-		else if( t.isDelimiter() )
-			f = d_delimiterFormat;
-		else if( t.isKeyWord() )
-			f = d_keyWordFormat;
-		else if( t.isIdent() )
-			f = d_identFormat;
-		else if( t.isAttr() )
-			f = d_attrFormat;
-		else
-			f = d_invalidFormat;
-		f.setProperty( TokenProp, t.d_type );
-		setFormat( t.d_col, t.d_len, f );
-		t = d_lex->nextToken();
+		if( d_doc->d_revision == document()->revision() )
+		{
+			// tokens of the whole document; tokens never span the block separator
+			const TokenStore& tokens = d_doc->d_tokens;
+			const QTextBlock b = currentBlock();
+			const int from = tokens.lowerBound( b.position() );
+			const int to = tokens.lowerBound( b.position() + b.length() - 1 );
+			BlockData* data = blockData();
+			data->assign( tokens, from, to, b.position() );
+			data->d_revision = b.revision();
+			data->d_prevState = previousBlockState();
+			// the state is whether the last token before the end of the block, except comments, is a tick
+			int last = to - 1;
+			while( last >= 0 && tokens.getType( last ) == LexerCore::T_Comment )
+				last--;
+			setCurrentBlockState( last >= 0 && tokens.getType( last ) == LexerCore::T_Tick );
+			updateDecls( data, text );
+			applyFormats( data, text );
+			return;
+		}
+		// else the block was edited; QSyntaxHighlighter calls this before onContentsChange() updates d_doc
+	}
+	// The block state is the lexer state at the end of the line, so an attribute on the next line is
+	// recognized. QSyntaxHighlighter only continues with the next block when the state changed, so an
+	// edit usually rehighlights only its own line.
+	const int prev = previousBlockState();
+	const QTextBlock b = currentBlock();
+	BlockData* data = static_cast<BlockData*>( currentBlockUserData() );
+	if( data != 0 && data->d_revision == b.revision() && data->d_prevState == prev &&
+			currentBlockState() != -1 && document()->isUndoRedoEnabled() )
+	{
+		// Neither the text nor the state it starts with changed, e.g. a block between the edits of
+		// Editor::onReplaceAll(), which QSyntaxHighlighter passes since they are one edit block.
+		// The tokens and the state are kept; the formats have to be set again anyway.
+		data->d_stamp = d_index->tick();
+		applyFormats( data, text );
+		return;
+	}
+	d_lex.setBuffer( text.constData(), text.constData() + text.size() );
+	d_lex.setState( ( prev == -1 ) ? 0 : prev );
+	d_lex.tokenize( d_tokens );
+	setCurrentBlockState( d_lex.getState() );
+	d_lex.setBuffer(0,0);
+	// the block is a single line, so the offset is the column
+	data = blockData();
+	data->assign( d_tokens, 0, d_tokens.getCount(), 0 );
+	data->d_revision = b.revision(); // only bumped by Qt if undo is enabled
+	data->d_prevState = prev;
+	updateDecls( data, text );
+	applyFormats( data, text );
+}
+
+BlockData* Highlighter::blockData()
+{
+	BlockData* data = static_cast<BlockData*>( currentBlockUserData() );
+	if( data == 0 )
+	{
+		data = new BlockData();
+		data->d_block = currentBlock();
+		setCurrentBlockUserData( data ); // owned by the block
+	}
+	return data;
+}
+
+void Highlighter::updateDecls(BlockData* data, const QString& text)
+{
+	if( data->d_index != d_index )
+	{
+		// first highlighted, or by another Highlighter of the document before
+		if( data->d_index )
+		{
+			data->d_index->remove( data->d_decls );
+			data->d_index->removeUser( data, data->d_names );
+		}
+		data->d_decls.clear();
+		data->d_names.clear();
+		data->d_index = d_index;
+	}
+	DeclIndex::Decls decls;
+	DeclIndex::extract( text, *data, decls );
+	if( !( decls == data->d_decls ) )
+	{
+		// only the declarations of this block are replaced in the index
+		d_index->remove( data->d_decls );
+		d_index->add( decls );
+		data->d_decls = decls;
+	}
+	QVector<uint> names;
+	for( int i = 0; i < data->getCount(); i++ )
+	{
+		if( data->getType( i ) == LexerCore::T_Identifier )
+			names.append( DeclIndex::hashName( text.constData() + data->getCol( i ), data->getLength( i ) ) );
+	}
+	qSort( names );
+	int n = 0;
+	for( int i = 0; i < names.size(); i++ )
+	{
+		if( n == 0 || names[n - 1] != names[i] )
+			names[n++] = names[i];
+	}
+	names.resize( n );
+	if( names != data->d_names )
+	{
+		d_index->removeUser( data, data->d_names );
+		d_index->addUser( data, names );
+		data->d_names = names;
+		data->d_names.squeeze();
+	}
+	data->d_stamp = d_index->tick();
+	if( !d_progressive && d_index->hasChanges() )
+		d_recolor.start(); // not from here, since QSyntaxHighlighter is busy with this block
+}
+
+quint8 Highlighter::classify(const QString& text, quint32 col, quint32 len)
+{
+	d_name.resize( len );
+	for( quint32 i = 0; i < len; i++ )
+		d_name[i] = text[col + i].toLower();
+	switch( d_index->classify( d_name ) )
+	{
+	case DeclIndex::K_Object:
+		return C_Object;
+	case DeclIndex::K_Subprogram:
+		return C_Subprogram;
+	case DeclIndex::K_Package:
+		return C_Package;
+	case DeclIndex::K_Type:
+		return C_Type;
+	default:
+		return C_Ident; // not declared in this document
+	}
+}
+
+void Highlighter::onRecolor()
+{
+	if( d_progressive )
+		return; // onSlice() starts again at the end of the pass
+	// only the blocks which use a name whose classification changed after they were highlighted;
+	// the changes are taken first, so the ones made by the blocks below start the timer again
+	QList<BlockData*> stale;
+	d_index->takeStale( stale );
+	for( int i = 0; i < stale.size(); i++ )
+	{
+		const QTextBlock b = stale[i]->d_block;
+		d_forced = b.blockNumber();
+		rehighlightBlock( b );
+		d_forced = -1;
+	}
+}
+
+void Highlighter::applyFormats(const BlockData* data, const QString& text)
+{
+	// adjacent tokens of the same category, e.g. ");" or "..", are set as one range
+	int cat = -1;
+	quint32 start = 0;
+	quint32 end = 0;
+	for( int i = 0; i < data->getCount(); i++ )
+	{
+		quint8 c = d_category[ data->getType( i ) ];
+		const quint32 off = data->getCol( i );
+		if( c == C_Ident )
+			c = classify( text, off, data->getLength( i ) );
+		if( c == cat && off == end )
+		{
+			end += data->getLength( i );
+			continue;
+		}
+		if( cat != -1 )
+			setFormat( start, end - start, d_formats[cat] );
+		cat = c;
+		start = off;
+		end = off + data->getLength( i );
 	}
-	d_lex->setStream(0);
+	if( cat != -1 )
+		setFormat( start, end - start, d_formats[cat] );
 }
@@ -21,31 +21,114 @@
 */
 
 #include <QSyntaxHighlighter>
+#include <QTextBlockUserData>
+#include <QTimer>
+#include <QFutureWatcher>
+#include <QSharedPointer>
+#include "AdaTokenStore.h"
+#include "AdaDeclIndex.h"
+#include "AdaTokenCache.h"
 
 namespace Ada
 {
-	class Lexer;
+	// Tokens of one block, kept by the Highlighter as the user data of the block, so they can be used
+	// without running the lexer again; positions are columns in the block.
+	class BlockData : public QTextBlockUserData
+	{
+	public:
+		int getCount() const { return d_toks.size(); }
+		quint8 getType( int i ) const { return d_toks[i].d_type; }
+		quint32 getCol( int i ) const { return d_toks[i].d_col; }
+		quint32 getLength( int i ) const { return d_toks[i].d_len; }
+		int findToken( quint32 col ) const; // index of the token covering col or -1
+		void assign( const TokenStore&, int from, int to, quint32 base ); // base is subtracted from the offsets
+		static const BlockData* get( const QTextBlock& b ) { return static_cast<const BlockData*>( b.userData() ); }
+		BlockData():d_stamp(0),d_revision(-1),d_prevState(-1) {}
+		~BlockData();
+	private:
+		friend class Highlighter;
+		friend class DeclIndex;
+		struct Tok
+		{
+			quint32 d_col;
+			quint32 d_len;
+			quint8 d_type;
+		};
+		QVector<Tok> d_toks;
+		DeclIndex::Decls d_decls;         // declared in this block
+		QVector<uint> d_names;            // hashes of the identifiers used in this block, sorted and unique
+		quint32 d_stamp;                  // DeclIndex::tick() when the block was highlighted
+		int d_revision;                   // QTextBlock::revision() when the tokens were made
+		int d_prevState;                  // state of the previous block then
+		QTextBlock d_block;               // the block owning this data
+		QSharedPointer<DeclIndex> d_index; // d_decls and d_names are registered there; blocks may outlive the Highlighter
+	};
 
 	class Highlighter : public QSyntaxHighlighter
 	{
+		Q_OBJECT
 	public:
-		enum { TokenProp = QTextFormat::UserProperty };
 		explicit Highlighter(QTextDocument *parent = 0);
+		~Highlighter();
 		static QString formatTokenType( quint8 );
+
+		// Progressive mode: blocks which were never highlighted are skipped by QSyntaxHighlighter's own
+		// passes and highlighted in idle time slices instead, the visible blocks first. Call before
+		// setPlainText(); the mode ends when all blocks are highlighted. Meanwhile worker threads
+		// tokenizes a snapshot of the document, so the slices only have to set the formats.
+		void beginProgressive();
+		bool isProgressive() const { return d_progressive; }
+		void setVisibleBlocks( int first, int last ); // block numbers
+		// The document was loaded from the file of the key; call after setPlainText(). The tokens are
+		// taken from the cache if there, otherwise the worker stores them.
+		void setCache( const TokenCache*, const TokenCache::Key& );
+
+		// Tokens of a whole document, made by worker threads and kept up to date by LexerCore::relex()
+		struct DocTokens
+		{
+			TokenStore d_tokens;
+			int d_revision; // of the document the tokens belong to
+		};
+		static DocTokens* tokenize( const QString& text, int revision ); // thread-safe; lexes chunks on all cores
+		static DocTokens* tokenizeAndStore( const QString& text, int revision, const TokenCache*, const TokenCache::Key& );
 	protected:
 		// Override
 		void highlightBlock( const QString & text );
+		QTextBlock nextPending();
+		void applyFormats( const BlockData*, const QString& text );
+		quint8 classify( const QString& text, quint32 col, quint32 len );
+		void updateDecls( BlockData*, const QString& text );
+		BlockData* blockData(); // of the current block
+		void startTokenizer();
+		void dropTokens();
+		void relexTokens( int pos, int removed, int added );
+	protected slots:
+		void onSlice();
+		void onContentsChange( int pos, int removed, int added );
+		void onTokenized();
+		void onRecolor();
 	private:
-		Lexer* d_lex;
-		QTextCharFormat d_commentFormat;
-		QTextCharFormat d_stringFormat;
-		QTextCharFormat d_charFormat;
-		QTextCharFormat d_numberFormat;
-		QTextCharFormat d_delimiterFormat;
-		QTextCharFormat d_keyWordFormat;
-		QTextCharFormat d_identFormat;
-		QTextCharFormat d_attrFormat;
-		QTextCharFormat d_invalidFormat;
+		enum Category { C_Invalid, C_Comment, C_String, C_Number, C_Delimiter, C_KeyWord, C_Ident, C_Attr,
+					   C_Object, C_Subprogram, C_Package, C_Type, C_Max }; // the last four are from d_index
+		LexerCore d_lex;
+		TokenStore d_tokens; // reused for each block
+		QTextCharFormat d_formats[C_Max]; // shared by all blocks, so the document only interns them once
+		quint8 d_category[LexerCore::T_EOF + 1]; // Category of each TokenType
+		QTimer d_timer;
+		int d_nextPos;  // the background pass continues with the block at this position
+		int d_visFirst; // visible blocks not yet checked
+		int d_visLast;
+		int d_forced;   // block number asked for by onSlice() or -1
+		bool d_progressive;
+		QFutureWatcher<DocTokens*> d_worker;
+		DocTokens* d_doc; // valid if its revision is the one of the document
+		bool d_workerResult; // the result of d_worker was not yet taken
+		const TokenCache* d_cache; // set until the worker stored the tokens of the loaded file
+		TokenCache::Key d_cacheKey;
+		int d_cacheRevision; // of the document when loaded
+		QSharedPointer<DeclIndex> d_index;
+		QTimer d_recolor;    // rehighlights the blocks which use names whose classification changed
+		QString d_name;      // reused by classify()
 	};
 }
 
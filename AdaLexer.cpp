@@ -18,7 +18,9 @@
 */
 
 #include "AdaLexer.h"
-#include <QIODevice>
+#include "AdaScanKernels.h"
+#include "AdaTokenStore.h"
+#include <QCoreApplication>
 #include <QTextStream>
 #include <QtDebug>
 using namespace Ada;
@@ -63,7 +65,38 @@ static const char* s_tokenName[] =
 	0
 };
 
-const char *Lexer::tokenName(quint8 type, bool asSymbol)
+enum { SP = LexerCore::C_Space, BL = LexerCore::C_Space | LexerCore::C_Print, PR = LexerCore::C_Print,
+	   US = LexerCore::C_Ident | LexerCore::C_Print,
+	   DI = LexerCore::C_Digit | LexerCore::C_Ident | LexerCore::C_ExtDigit | LexerCore::C_Print,
+	   HX = LexerCore::C_Letter | LexerCore::C_Ident | LexerCore::C_ExtDigit | LexerCore::C_Print,
+	   LE = LexerCore::C_Letter | LexerCore::C_Ident | LexerCore::C_Print };
+
+// Classification of the ASCII characters; the Unicode functions of QChar are only used above 0x7f
+const quint8 LexerCore::s_charClass[128] =
+{
+	 0,  0,  0,  0,  0,  0,  0,  0,  0, SP, SP, SP, SP, SP,  0,  0, // 0x00
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 0x10
+	BL, PR, PR, PR, PR, PR, PR, PR, PR, PR, PR, PR, PR, PR, PR, PR, // 0x20
+	DI, DI, DI, DI, DI, DI, DI, DI, DI, DI, PR, PR, PR, PR, PR, PR, // 0x30
+	PR, HX, HX, HX, HX, HX, HX, LE, LE, LE, LE, LE, LE, LE, LE, LE, // 0x40
+	LE, LE, LE, LE, LE, LE, LE, LE, LE, LE, LE, PR, PR, PR, PR, US, // 0x50
+	PR, HX, HX, HX, HX, HX, HX, LE, LE, LE, LE, LE, LE, LE, LE, LE, // 0x60
+	LE, LE, LE, LE, LE, LE, LE, LE, LE, LE, LE, PR, PR, PR, PR,  0  // 0x70
+};
+
+static const char* s_errorText[] =
+{
+	"",
+	QT_TRANSLATE_NOOP( "Ada::Lexer", "unexpected character '%1'" ),
+	QT_TRANSLATE_NOOP( "Ada::Lexer", "non terminated string" ),
+	QT_TRANSLATE_NOOP( "Ada::Lexer", "expecting digit" ),
+	QT_TRANSLATE_NOOP( "Ada::Lexer", "expecting extended digit" ),
+	QT_TRANSLATE_NOOP( "Ada::Lexer", "expecting #" ),
+	QT_TRANSLATE_NOOP( "Ada::Lexer", "expecting plus, minus or digit" ),
+	0
+};
+
+const char *LexerCore::tokenName(quint8 type, bool asSymbol)
 {
 	if( type <= T_EOF )
 	{
@@ -132,54 +165,41 @@ const char *Lexer::tokenName(quint8 type, bool asSymbol)
 		return "?";
 }
 
-Lexer::Lexer(QObject *parent) :
-	QObject(parent), d_in(0),d_lineNr(0),d_colNr(0),d_ownsStream(false),d_lastTokenType(T_Invalid)
-{
-}
-
-Lexer::~Lexer()
+LexerCore::LexerCore() :
+	d_begin(0),d_end(0),d_cur(0),d_line(0),d_lineLen(0),
+	d_lineNr(0),d_colNr(0),d_lastTokenType(T_Invalid)
 {
-	if( d_in && d_ownsStream )
-		delete d_in;
 }
 
-void Lexer::setStream(QTextStream *in, bool haveOwnership )
+void LexerCore::setBuffer(const QChar* begin, const QChar* end)
 {
-	if( d_in != 0 && d_ownsStream )
-		delete d_in;
-	d_in = in;
-	d_ownsStream = haveOwnership;
+	d_begin = begin;
+	d_end = end;
 	reset();
 }
 
-void Lexer::reset()
+void LexerCore::reset()
 {
-	if( d_in )
-	{
-		d_in->seek(0);
-		d_in->reset();
-		d_in->resetStatus();
-	}
+	d_cur = d_begin;
 	d_lineNr = 0;
 	d_colNr = 0;
-	d_line.clear();
+	d_line = d_begin; // so the offset of the EOF token of an empty buffer is 0
+	d_lineLen = 0;
 	d_lastTokenType = T_Invalid;
 }
 
-Lexer::Token Lexer::nextToken()
+LexerCore::Token LexerCore::nextToken()
 {
-	if( d_in == 0 )
-		return token( T_EOF, 0 );
 	skipWhiteSpace();
-	while( d_colNr >= d_line.size() )
+	while( d_colNr >= d_lineLen )
 	{
-		if( d_in->atEnd() )
+		if( d_cur >= d_end )
 			return token( T_EOF, 0 );
 		nextLine();
 		skipWhiteSpace();
 	}
-	Q_ASSERT( d_colNr < d_line.size() );
-	while( d_colNr < d_line.size() )
+	Q_ASSERT( d_colNr < d_lineLen );
+	while( d_colNr < d_lineLen )
 	{
 		const QChar ch = d_line[d_colNr];
 		const ushort ucs = ch.unicode();
@@ -202,7 +222,7 @@ Lexer::Token Lexer::nextToken()
 			return token( T_Comma );
 		case '-':
 			if( lookAhead(1) == '-' )
-				return token(T_Comment, d_line.size() - d_colNr, d_line.mid( d_colNr + 2 ) );
+				return token(T_Comment, d_lineLen - d_colNr );
 			else
 				return token(T_Minus);
 		case '.':
@@ -253,7 +273,7 @@ Lexer::Token Lexer::nextToken()
 			return token( T_Bar);
 		case '\'':
 			if( lookAhead(2) == '\'' )
-				return token( T_Character, 3, d_line.mid( d_colNr + 1, 1 ) );
+				return token( T_Character, 3 );
 			else
 				return token( T_Tick );
 		case '"':
@@ -261,25 +281,101 @@ Lexer::Token Lexer::nextToken()
 		default:
 			break;
 		}
-		if( ch.isDigit() )
+		if( isDigitChar( ucs ) )
 		{
 			// Numeric Literal
 			return numeric();
-		}else if( ch.isLetter() )
+		}else if( isLetterChar( ucs ) )
 		{
 			// Identifier oder Reserved Word
 			return ident();
 		}else
 		{
 			// Error
-			return token( T_Invalid, 1, tr("unexpected character '%1'").arg(ch) );
+			return token( T_Invalid, 1, E_UnexpectedChar );
 		}
 	}
 	Q_ASSERT( false );
 	return T_Invalid;
 }
 
-bool Lexer::isAda83KeyWord(quint8 type)
+int LexerCore::tokenize(TokenStore& out)
+{
+	out.clear();
+	Token t = nextToken();
+	while( !t.isEof() )
+	{
+		out.append( t );
+		t = nextToken();
+	}
+	return out.getCount();
+}
+
+static bool _tickBefore( const TokenStore& tokens, int i, int stop, bool stateAtStop )
+{
+	// the state of the lexer before token i, as set by the last token which is not a comment
+	while( --i >= stop )
+	{
+		if( tokens.getType( i ) != LexerCore::T_Comment )
+			return tokens.getType( i ) == LexerCore::T_Tick;
+	}
+	return stateAtStop;
+}
+
+LexerCore::Delta LexerCore::relex(TokenStore& tokens, const Edit& e, const QChar* begin, const QChar* end,
+								  quint32 off, quint32 line, bool atEnd)
+{
+	Q_ASSERT( off <= e.d_pos );
+	const qint32 delta = qint32( e.d_inserted ) - qint32( e.d_removed );
+	const int first = tokens.lowerBound( off ); // tokens before off are not affected by the edit
+	const bool state = _tickBefore( tokens, first, 0, false );
+	LexerCore lex;
+	lex.setBuffer( begin, end );
+	lex.setState( state );
+	bool tick = state;
+	TokenStore fresh;
+	int old = first; // candidate of the old tokens to line up with
+	qint32 lineDelta = 0;
+	bool synced = false;
+	Token t = lex.nextToken();
+	while( !t.isEof() )
+	{
+		t.d_off += off;
+		t.d_line += line - 1;
+		if( t.d_off >= e.d_pos + e.d_inserted )
+		{
+			// behind the edit the old tokens are at t.d_off - delta
+			const quint32 oldOff = t.d_off - delta;
+			while( old < tokens.getCount() && tokens.getOffset( old ) < oldOff )
+				old++;
+			if( old < tokens.getCount() && tokens.getOffset( old ) == oldOff &&
+					tokens.getType( old ) == t.d_type && tokens.getLength( old ) == t.d_len &&
+					_tickBefore( tokens, old, first, state ) == tick )
+			{
+				// the token is replaced too, so its line entry in the store gets the new line start
+				lineDelta = qint32( t.d_line ) - qint32( tokens.getLine( old ) );
+				fresh.append( t );
+				old++;
+				synced = true;
+				break;
+			}
+		}
+		fresh.append( t );
+		if( t.d_type != T_Comment )
+			tick = t.d_type == T_Tick;
+		t = lex.nextToken();
+	}
+	if( !synced )
+	{
+		if( !atEnd )
+			return Delta();
+		old = tokens.getCount();
+	}
+	tokens.replace( first, old - first, fresh, delta, lineDelta );
+	return Delta( first, old - first, fresh.getCount() );
+}
+
+bool LexerCore::isAda83KeyWord(quint8 type)
 {
 	switch( type )
 	{
@@ -352,7 +448,7 @@ bool Lexer::isAda83KeyWord(quint8 type)
 	}
 }
 
-bool Lexer::isAda95KeyWord(quint8 type)
+bool LexerCore::isAda95KeyWord(quint8 type)
 {
 	switch( type )
 	{
@@ -368,7 +464,7 @@ bool Lexer::isAda95KeyWord(quint8 type)
 	}
 }
 
-bool Lexer::isAda05KeyWord(quint8 type)
+bool LexerCore::isAda05KeyWord(quint8 type)
 {
 	switch( type )
 	{
@@ -381,7 +477,7 @@ bool Lexer::isAda05KeyWord(quint8 type)
 	}
 }
 
-bool Lexer::isAda12KeyWord(quint8 type)
+bool LexerCore::isAda12KeyWord(quint8 type)
 {
 	if( type == T_some )
 		return true;
@@ -389,37 +485,51 @@ bool Lexer::isAda12KeyWord(quint8 type)
 		return isAda05KeyWord(type);
 }
 
-bool Lexer::isKeyWord(quint8 type)
+bool LexerCore::isKeyWord(quint8 type)
 {
 	return type >= T_abort && type <= T_xor;
 }
 
-bool Lexer::isDelimiter(quint8 type)
+bool LexerCore::isDelimiter(quint8 type)
 {
 	return type >= T_Colon && type <= T_Box;
 }
 
-bool Lexer::isNumber(quint8 type)
+bool LexerCore::isNumber(quint8 type)
 {
 	return type == T_Number;
 }
 
-void Lexer::nextLine()
+void LexerCore::nextLine()
 {
 	d_colNr = 0;
 	d_lineNr++;
-	d_line = d_in->readLine();
+	// same as QTextStream::readLine(): a line ends with \n or the end of the buffer, a preceding \r is dropped
+	const QChar* p = reinterpret_cast<const QChar*>( ScanKernels::findNewline(
+								reinterpret_cast<const ushort*>( d_cur ), reinterpret_cast<const ushort*>( d_end ) ) );
+	d_line = d_cur;
+	d_lineLen = p - d_cur;
+	if( d_lineLen > 0 && d_line[d_lineLen - 1].unicode() == '\r' )
+		d_lineLen--;
+	d_cur = ( p < d_end ) ? p + 1 : p;
 }
 
-void Lexer::skipWhiteSpace()
+void LexerCore::skipWhiteSpace()
 {
-	while( d_colNr < d_line.size() && d_line[d_colNr].isSpace() )
-		d_colNr++;
+	const ushort* line = reinterpret_cast<const ushort*>( d_line );
+	while( d_colNr < d_lineLen )
+	{
+		d_colNr = ScanKernels::skipAsciiSpace( line + d_colNr, line + d_lineLen ) - line;
+		if( d_colNr < d_lineLen && isSpaceChar( line[d_colNr] ) )
+			d_colNr++; // Unicode space
+		else
+			break;
+	}
 }
 
-char Lexer::lookAhead(quint32 off) const
+char LexerCore::lookAhead(quint32 off) const
 {
-	if( int( d_colNr + off ) < d_line.size() )
+	if( d_colNr + off < d_lineLen )
 	{
 		const QChar ch = d_line[ d_colNr + off ];
 		if( ch.unicode() < 0xff )
@@ -430,484 +540,216 @@ char Lexer::lookAhead(quint32 off) const
 		return 0;
 }
 
-QChar Lexer::lookAhead2(quint32 off) const
+QChar LexerCore::lookAhead2(quint32 off) const
 {
-	if( int( d_colNr + off ) < d_line.size() )
+	if( d_colNr + off < d_lineLen )
 		return d_line[ d_colNr + off ];
 	else
 		return QChar();
 }
 
-Lexer::Token Lexer::token(Lexer::TokenType tt, int len, const QString &val)
+LexerCore::Token LexerCore::token(LexerCore::TokenType tt, int len, Error err)
 {
-	Token t( tt, d_lineNr, d_colNr, len, val );
+	Token t( tt, d_lineNr, d_colNr, len, ( d_line - d_begin ) + d_colNr, d_line + d_colNr, err );
 	d_colNr += len;
-	d_lastTokenType = tt;
+	if( tt != T_Comment && tt != T_EOF )
+		d_lastTokenType = tt; // a comment may come between a tick and the attribute on the next line
 	return t;
 }
 
-Lexer::Token Lexer::string()
+QString LexerCore::Token::getString() const
 {
-	int off = 1;
+	if( d_src == 0 )
+		return QString();
+	switch( d_type )
+	{
+	case T_Invalid:
+		return getError();
+	case T_Character:
+		return QString( d_src + 1, 1 );
+	case T_String:
+		return QString( d_src + 1, d_len - 2 ).replace( QLatin1String("\"\""), QLatin1String("\"") );
+	case T_Comment:
+		return QString( d_src + 2, d_len - 2 );
+	default:
+		return QString( d_src, d_len );
+	}
+}
+
+QString LexerCore::Token::getError() const
+{
+	return errorMessage( d_err, ( d_src != 0 ) ? *d_src : QChar() );
+}
+
+const char* LexerCore::errorText(quint8 error)
+{
+	if( error <= E_ExpectingExponent )
+		return s_errorText[error];
+	else
+		return "";
+}
+
+QString LexerCore::errorMessage(quint8 error, QChar ch)
+{
+	if( error == E_None || error > E_ExpectingExponent )
+		return QString();
+	const QString msg = QCoreApplication::translate( "Ada::Lexer", s_errorText[error] );
+	if( error == E_UnexpectedChar )
+		return msg.arg( ch );
+	else
+		return msg;
+}
+
+LexerCore::Token LexerCore::string()
+{
+	const ushort* start = reinterpret_cast<const ushort*>( d_line + d_colNr );
+	const ushort* end = reinterpret_cast<const ushort*>( d_line + d_lineLen );
+	const ushort* p = start + 1;
 	while(true)
 	{
-		const QChar ch = lookAhead2(off);
-		if( ch.unicode() == '"' )
+		p = ScanKernels::findStringStop( p, end );
+		if( p < end && *p == '"' )
 		{
-			if( lookAhead(off + 1) == '"' )
+			if( p + 1 < end && p[1] == '"' )
 			{
-				off += 2;
+				p += 2;
 			}else
 			{
 				break; // End of String
 			}
-		}else if( ch.isPrint() )
-			off++;
-		else if( ch.isNull() )
-			return token( T_Invalid, d_line.size() - d_colNr, tr("non terminated string") );
+		}else if( p < end && isPrintChar( *p ) )
+			p++; // printable non-ASCII character
+		else
+			// end of line or a character not allowed in a string
+			return token( T_Invalid, d_lineLen - d_colNr, E_NonTerminatedString );
 	}
-	const QString str = d_line.mid( d_colNr + 1, off - 1 ).replace( "\"\"", "\"" );
-	return token( T_String, off + 1, str );
+	return token( T_String, p - start + 1 ); // "" is only decoded by Token::getString()
 }
 
-Lexer::Token Lexer::ident()
+LexerCore::Token LexerCore::ident()
 {
 	// Hier wurde bereits geprft, dass lookAhead2(0).isLetter() gilt
 	int off = 0;
 	while( true )
 	{
 		const QChar ch = lookAhead2(off);
-		if( !ch.isLetterOrNumber() && ch.unicode() != '_' )
+		if( !isIdentChar( ch.unicode() ) )
 			break;
 		else
 			off++;
 	}
-	const QString str = d_line.mid(d_colNr, off );
-	const TokenType tt = findReservedWord( str );
+	const TokenType tt = findReservedWord( d_line + d_colNr, off );
 	if( d_lastTokenType == T_Tick )
-		return token( T_Attribute, off, str );
+		return token( T_Attribute, off );
 	else if( tt != T_Invalid )
 		return token( tt, off ); // TODO: Ada-Version prfen
 	else
-		return token( T_Identifier, off, str );
+		return token( T_Identifier, off );
 }
 
-Lexer::Token Lexer::numeric()
+LexerCore::Token LexerCore::numeric()
 {
-	// qDebug() << "AdaLexer::numeric" << d_colNr << d_line.mid(d_colNr);
+	// qDebug() << "AdaLexer::numeric" << d_colNr << QString( d_line + d_colNr, d_lineLen - d_colNr );
 
 	// Hier wurde bereits geprft, dass lookAhead2(0).isDigit() gilt
-	NumberParser np( d_line, d_colNr );
+	NumberParser np( d_line, d_lineLen, d_colNr );
 	if( !np.parse() )
 	{
-		return token( T_Invalid, np.getOff(), tr( np.getError() ) );
+		return token( T_Invalid, np.getOff(), np.getError() );
 	}
-	return token( T_Number, np.getOff(), d_line.mid( d_colNr, np.getOff() ) );
+	return token( T_Number, np.getOff() );
 }
 
-static inline ushort at( const QString& str, int off )
+// Perfect hash over the reserved words. The multipliers are searched by genReservedWords.py so that the
+// first and the last two characters together with the length select a distinct slot in the table of
+// findReservedWord() for each reserved word; after adding a reserved word run it with -generate and
+// paste its output, without options it checks the multipliers and the table. AdaLexerTest looks up
+// every reserved word too.
+static inline quint32 _hashWord( quint32 first, quint32 beforeLast, quint32 last, quint32 len )
 {
-	if( off >= 0 && off < str.size() )
-		return str[off].unicode();
-	else
-		return 0;
+	return ( first * 1133697009u + beforeLast * 2439130655u + last * 2861346243u + len * 4084761625u ) >> 24;
 }
 
-static inline bool check( const QString& str, int off, const char* match )
+LexerCore::TokenType LexerCore::findReservedWord(const QString & str)
 {
-	// qDebug() << str << off << match;
-	int i = 0;
-	for( i = off; i < str.length(); i++ )
-	{
-		if( str[i].toLower().unicode() != match[i - off] )
-			return false;
-	}
-	if( match[i - off] != 0 )
-		return false;
-	// Macht Kopie: return str.mid( off ).toLower().toAscii() == match;
-	return true;
+	return findReservedWord( str.constData(), str.size() );
 }
 
-Lexer::TokenType Lexer::findReservedWord(const QString & str)
+LexerCore::TokenType LexerCore::findReservedWord(const QChar* str, int len)
 {
-	switch( at(str,0) )
+	static const quint8 s_reservedWords[256] =
 	{
-	case 'a':
-	case 'A':
-		switch( at(str,1) )
-		{
-		case 'b':
-		case 'B':
-			switch( at(str,2) )
-			{
-			case 'o':
-			case 'O':
-				if( check( str, 3, "rt" ) )
-					return T_abort;
-				break;
-			case 's':
-			case 'S':
-				if( at(str,3) == 0 )
-					return T_abs;
-				else if( check( str, 3, "tract" ) )
-					return T_abstract;
-				break;
-			default:
-				break;
-			}
-			break;
-		case 'c':
-		case 'C':
-			if( check( str, 2, "cept" ) )
-				return T_accept;
-			else if( check( str, 2, "cess" ) )
-				return T_access;
-			break;
-		case 'l':
-		case 'L':
-			if( check( str, 2, "iased" ) )
-				return T_aliased;
-			else if( check( str, 2, "l" ) )
-				return T_all;
-			break;
-		case 'n':
-		case 'N':
-			if( check( str, 2, "d" ) )
-				return T_and;
-			break;
-		case 'r':
-		case 'R':
-			if( check( str, 2, "ray" ) )
-				return T_array;
-			break;
-		case 't':
-		case 'T':
-			if( at(str,3) == 0 )
-				return T_at;
-			break;
-		default:
-			break;
-		}
-		break;
-	case 'b':
-	case 'B':
-		switch( at(str,1) )
-		{
-		case 'e':
-		case 'E':
-			if( check( str, 2, "gin" ) )
-				return T_begin;
-			break;
-		case 'o':
-		case 'O':
-			if( check( str, 2, "dy" ) )
-				return T_body;
-			break;
-		default:
-			break;
-		}
-		break;
-	case 'c':
-	case 'C':
-		switch( at(str,1) )
-		{
-		case 'a':
-		case 'A':
-			if( check( str, 2, "se" ) )
-				return T_case;
-			break;
-		case 'o':
-		case 'O':
-			if( check( str, 2, "nstant" ) )
-				return T_constant;
-			break;
-		default:
-			break;
-		}
-		break;
-	case 'd':
-	case 'D':
-		switch( at(str,1) )
-		{
-		case 'e':
-		case 'E':
-			if( check( str, 2, "clare" ) )
-				return T_declare;
-			else if( check( str, 2, "lay" ) )
-				return T_delay;
-			else if( check( str, 2, "lta" ) )
-				return T_delta;
-			break;
-		case 'i':
-		case 'I':
-			if( check( str, 2, "gits" ) )
-				return T_digits;
-			break;
-		case 'o':
-		case 'O':
-			if( check( str, 2, "" ) )
-				return T_do;
-			break;
-		default:
-			break;
-		}
-		break;
-	case 'e':
-	case 'E':
-		switch( at(str,1) )
-		{
-		case 'l':
-		case 'L':
-			if( check( str, 2, "se" ) )
-				return T_else;
-			else if( check( str, 2, "sif" ) )
-				return T_elsif;
-			break;
-		case 'n':
-		case 'N':
-			if( check( str, 2, "d" ) )
-				return T_end;
-			else if( check( str, 2, "try" ) )
-				return T_entry;
-			break;
-		case 'x':
-		case 'X':
-			if( check( str, 2, "ception" ) )
-				return T_exception;
-			else if( check( str, 2, "it" ) )
-				return T_exit;
-			break;
-		default:
-			break;
-		}
-		break;
-	case 'f':
-	case 'F':
-		if( check( str, 1, "or" ) )
-			return T_for;
-		else if( check( str, 1, "unction" ) )
-			return T_function;
-		break;
-	case 'g':
-	case 'G':
-		if( check( str, 1, "eneric" ) )
-			return T_generic;
-		else if( check( str, 1, "oto" ) )
-			return T_goto;
-		break;
-	case 'i':
-	case 'I':
-		switch( at(str,1) )
-		{
-		case 'f':
-		case 'F':
-			if( check( str, 2, "" ) )
-				return T_if;
-			break;
-		case 'n':
-		case 'N':
-			if( check( str, 2, "terface" ) )
-				return T_interface;
-			else if ( check( str, 2, "" ) )
-				return T_in;
-			break;
-		case 's':
-		case 'S':
-			if( check( str, 2, "" ) )
-				return T_is;
-			break;
-		default:
-			break;
-		}
-		break;
-	case 'l':
-	case 'L':
-		if( check( str, 1, "imited" ) )
-			return T_limited;
-		else if( check( str, 1, "oop" ) )
-			return T_loop;
-		break;
-	case 'm':
-	case 'M':
-		if( check( str, 1, "od" ) )
-			return T_mod;
-		break;
-	case 'n':
-	case 'N':
-		if( check( str, 1, "ew" ) )
-			return T_new;
-		else if( check( str, 1, "ot" ) )
-			return T_not;
-		else if( check( str, 1, "ull" ) )
-			return T_null;
-		break;
-	case 'o':
-	case 'O':
-		if( check( str, 1, "f" ) )
-			return T_of;
-		else if( check( str, 1, "r" ) )
-			return T_or;
-		else if( check( str, 1, "thers" ) )
-			return T_others;
-		else if( check( str, 1, "ut" ) )
-			return T_out;
-		else if( check( str, 1, "verriding" ) )
-			return T_overriding;
-		break;
-	case 'p':
-	case 'P':
-		switch( at(str,1) )
-		{
-		case 'a':
-		case 'A':
-			if( check( str, 2, "ckage" ) )
-				return T_package;
-			break;
-		case 'r':
-		case 'R':
-			if( check( str, 2, "agma" ) )
-				return T_pragma;
-			else if ( check( str, 2, "ivate" ) )
-				return T_private;
-			else if ( check( str, 2, "ocedure" ) )
-				return T_procedure;
-			else if ( check( str, 2, "otected" ) )
-				return T_protected;
-			break;
-		default:
-			break;
-		}
-		break;
-	case 'r':
-	case 'R':
-		switch( at(str,1) )
-		{
-		case 'a':
-		case 'A':
-			if( check( str, 2, "ise" ) )
-				return T_raise;
-			else if ( check( str, 2, "nge" ) )
-				return T_range;
-			break;
-		case 'e':
-		case 'E':
-			if( check( str, 2, "cord" ) )
-				return T_record;
-			else if ( check( str, 2, "m" ) )
-				return T_rem;
-			else if ( check( str, 2, "names" ) )
-				return T_renames;
-			else if ( check( str, 2, "queue" ) )
-				return T_requeue;
-			else if ( check( str, 2, "turn" ) )
-				return T_return;
-			else if ( check( str, 2, "verse" ) )
-				return T_reverse;
-			break;
-		default:
-			break;
-		}
-		break;
-	case 's':
-	case 'S':
-		switch( at(str,1) )
-		{
-		case 'e':
-		case 'E':
-			if( check( str, 2, "lect" ) )
-				return T_select;
-			else if ( check( str, 2, "parate" ) )
-				return T_separate;
-			break;
-		case 'o':
-		case 'O':
-			if( check( str, 2, "me" ) )
-				return T_some;
-			break;
-		case 'u':
-		case 'U':
-			if( check( str, 2, "btype" ) )
-				return T_subtype;
-			break;
-		case 'y':
-		case 'Y':
-			if( check( str, 2, "nchronized" ) )
-				return T_synchronized;
-			break;
-		default:
-			break;
-		}
-		break;
-	case 't':
-	case 'T':
-		switch( at(str,1) )
-		{
-		case 'a':
-		case 'A':
-			if( check( str, 2, "gged" ) )
-				return T_tagged;
-			else if ( check( str, 2, "sk" ) )
-				return T_task;
-			break;
-		case 'e':
-		case 'E':
-			if( check( str, 2, "rminate" ) )
-				return T_terminate;
-			break;
-		case 'h':
-		case 'H':
-			if( check( str, 2, "en" ) )
-				return T_then;
-			break;
-		case 'y':
-		case 'Y':
-			if( check( str, 2, "pe" ) )
-				return T_type;
-			break;
-		default:
-			break;
-		}
-		break;
-	case 'u':
-	case 'U':
-		if( check( str, 1, "ntil" ) )
-			return T_until;
-		else if( check( str, 1, "se" ) )
-			return T_use;
-		break;
-	case 'w':
-	case 'W':
-		switch( at(str,1) )
-		{
-		case 'h':
-		case 'H':
-			if( check( str, 2, "en" ) )
-				return T_when;
-			else if( check( str, 2, "ile" ) )
-				return T_while;
-			break;
-		case 'i':
-		case 'I':
-			if( check( str, 2, "th" ) )
-				return T_with;
-			break;
-		default:
-			break;
-		}
-		break;
-	case 'x':
-	case 'X':
-		if( check( str, 1, "or" ) )
-			return T_xor;
-		break;
-	default:
-		break;
+		T_package, T_Invalid, T_Invalid, T_Invalid, T_task, T_Invalid, T_Invalid, T_Invalid,
+		T_Invalid, T_do, T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_array, T_else,
+		T_then, T_Invalid, T_body, T_Invalid, T_declare, T_Invalid, T_Invalid, T_Invalid,
+		T_Invalid, T_Invalid, T_protected, T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_null,
+		T_separate, T_Invalid, T_Invalid, T_Invalid, T_limited, T_Invalid, T_procedure, T_Invalid,
+		T_record, T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_or,
+		T_Invalid, T_of, T_accept, T_if, T_not, T_Invalid, T_Invalid, T_Invalid,
+		T_until, T_Invalid, T_Invalid, T_access, T_Invalid, T_aliased, T_Invalid, T_Invalid,
+		T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_Invalid,
+		T_mod, T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_tagged, T_Invalid,
+		T_type, T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_use, T_Invalid, T_terminate,
+		T_reverse, T_some, T_Invalid, T_Invalid, T_others, T_Invalid, T_Invalid, T_exit,
+		T_with, T_abort, T_private, T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_Invalid,
+		T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_generic, T_Invalid,
+		T_Invalid, T_raise, T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_Invalid,
+		T_Invalid, T_Invalid, T_Invalid, T_requeue, T_Invalid, T_constant, T_Invalid, T_Invalid,
+		T_Invalid, T_Invalid, T_Invalid, T_xor, T_Invalid, T_Invalid, T_new, T_in,
+		T_case, T_begin, T_exception, T_Invalid, T_and, T_Invalid, T_Invalid, T_Invalid,
+		T_select, T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_digits,
+		T_Invalid, T_Invalid, T_end, T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_Invalid,
+		T_range, T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_delta, T_Invalid,
+		T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_Invalid,
+		T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_abstract,
+		T_renames, T_abs, T_Invalid, T_Invalid, T_Invalid, T_all, T_Invalid, T_synchronized,
+		T_Invalid, T_Invalid, T_Invalid, T_for, T_entry, T_Invalid, T_Invalid, T_Invalid,
+		T_interface, T_while, T_Invalid, T_pragma, T_Invalid, T_Invalid, T_Invalid, T_Invalid,
+		T_Invalid, T_goto, T_return, T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_Invalid,
+		T_Invalid, T_delay, T_function, T_when, T_is, T_Invalid, T_Invalid, T_at,
+		T_out, T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_overriding, T_subtype,
+		T_Invalid, T_Invalid, T_Invalid, T_rem, T_Invalid, T_Invalid, T_Invalid, T_Invalid,
+		T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_loop, T_Invalid,
+		T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_Invalid, T_elsif
+	};
+	if( len < 2 || len > 12 )
+		return T_Invalid;
+	// ASCII case folding: ch | 0x20 maps A..Z to a..z; no other character is mapped to a lower case letter,
+	// so words with other characters fail the comparison below
+	const ushort* s = reinterpret_cast<const ushort*>( str );
+	const quint8 tt = s_reservedWords[ _hashWord( s[0] | 0x20, s[len - 2] | 0x20, s[len - 1] | 0x20, len ) ];
+	if( tt == T_Invalid )
+		return T_Invalid;
+	const char* word = s_tokenName[tt];
+	for( int i = 0; i < len; i++ )
+	{
+		if( ( s[i] | 0x20 ) != uchar( word[i] ) )
+			return T_Invalid; // also stops at the terminating zero of a shorter word
 	}
-	return T_Invalid;
+	if( word[len] != 0 )
+		return T_Invalid;
+	return TokenType( tt );
+}
+
+LexerCore::TokenType LexerCore::findReservedWord(const char* str, int len)
+{
+	if( len < 2 || len > 12 )
+		return T_Invalid;
+	// bytes above 0x7f never match, so the UTF-8 encoding of a non-ASCII letter is no issue
+	QChar buf[12];
+	for( int i = 0; i < len; i++ )
+		buf[i] = QChar( ushort( uchar( str[i] ) ) );
+	return findReservedWord( buf, len );
 }
 
-NumberParser::NumberParser(const QString & str, int start):
-	d_str(str),d_start(start),d_off(start),d_hasDecimals(false),
+NumberParser::NumberParser(const QChar* str, int len, int start):
+	d_error(LexerCore::E_None),d_str(str),d_bytes(0),d_len(len),d_start(start),d_off(start),d_hasDecimals(false),
+	d_hasExponent(false),d_isBased(false)
+{
+}
+
+NumberParser::NumberParser(const char* str, int len, int start):
+	d_error(LexerCore::E_None),d_str(0),d_bytes(str),d_len(len),d_start(start),d_off(start),d_hasDecimals(false),
 	d_hasExponent(false),d_isBased(false)
 {
 }
@@ -919,6 +761,7 @@ bool NumberParser::parse()
 	// base ::= numeral
 
 	d_off = 0;
+	d_error = LexerCore::E_None;
 	d_hasDecimals = false;
 	d_hasExponent = false;
 	d_isBased = false;
@@ -942,7 +785,7 @@ bool NumberParser::parse()
 				return false;
 		}
 		if( lookAhead( d_off ) != QLatin1Char('#') )
-			return error( "expecting #" );
+			return error( LexerCore::E_ExpectingHash );
 		d_off++;
 
 		if( lookAhead( d_off ).toLower() == QLatin1Char('e') )
@@ -981,25 +824,25 @@ bool NumberParser::numeral()
 	// An underline character in a numeric_literal does not affect its meaning.
 
 	QChar ch = lookAhead( d_off );
-	if( !ch.isDigit() )
-		return error( "expecting digit" );
+	if( !LexerCore::isDigitChar( ch.unicode() ) )
+		return error( LexerCore::E_ExpectingDigit );
 	d_off++;
 	ch = lookAhead( d_off );
 	while( true )
 	{
-		if( ch == QLatin1Char('_') || ch.isDigit() )
+		if( ch == QLatin1Char('_') || LexerCore::isDigitChar( ch.unicode() ) )
 		{
 			if( ch == QLatin1Char('_') )
 			{
 				d_off++;
 				ch = lookAhead( d_off );
-				if( ch.isDigit() )
+				if( LexerCore::isDigitChar( ch.unicode() ) )
 				{
 					d_off++;
 					ch = lookAhead( d_off );
 				}else
-					return error( "expecting digit" );
-			}else if( ch.isDigit() )
+					return error( LexerCore::E_ExpectingDigit );
+			}else if( LexerCore::isDigitChar( ch.unicode() ) )
 			{
 				d_off++;
 				ch = lookAhead( d_off );
@@ -1010,28 +853,9 @@ bool NumberParser::numeral()
 	return true;
 }
 
-static bool extended_digit( const QChar& ch )
+static inline bool extended_digit( const QChar& ch )
 {
-	if( ch.isDigit() )
-		return true;
-	switch( ch.unicode() )
-	{
-	case 'a':
-	case 'A':
-	case 'b':
-	case 'B':
-	case 'c':
-	case 'C':
-	case 'd':
-	case 'D':
-	case 'e':
-	case 'E':
-	case 'f':
-	case 'F':
-		return true;
-	default:
-		return false;
-	}
+	return LexerCore::isExtDigitChar( ch.unicode() );
 }
 
 bool NumberParser::basedNumeral()
@@ -1044,7 +868,7 @@ bool NumberParser::basedNumeral()
 
 	QChar ch = lookAhead( d_off );
 	if( !extended_digit(ch) )
-		return error( "expecting extended digit" );
+		return error( LexerCore::E_ExpectingExtDigit );
 	d_off++;
 	ch = lookAhead( d_off );
 	while( true )
@@ -1060,7 +884,7 @@ bool NumberParser::basedNumeral()
 					d_off++;
 					ch = lookAhead( d_off );
 				}else
-					return error( "expecting extended digit" );
+					return error( LexerCore::E_ExpectingExtDigit );
 			}else if( extended_digit(ch) )
 			{
 				d_off++;
@@ -1084,7 +908,7 @@ bool NumberParser::exponent()
 	// without the exponent is to be multiplied to obtain the value of the decimal_literal with the exponent.
 
 	QChar ch = lookAhead( d_off );
-	if( ch == QLatin1Char('+') || ch == QLatin1Char('-') || ch.isDigit() )
+	if( ch == QLatin1Char('+') || ch == QLatin1Char('-') || LexerCore::isDigitChar( ch.unicode() ) )
 	{
 		if( ch == QLatin1Char('+') || ch == QLatin1Char('-') )
 		{
@@ -1092,29 +916,76 @@ bool NumberParser::exponent()
 			ch = lookAhead( d_off );
 			if( !numeral() )
 				return false;
-		}else if( ch.isDigit() )
+		}else if( LexerCore::isDigitChar( ch.unicode() ) )
 		{
 			if( !numeral() )
 				return false;
 		}
 	}else
-		return error( "expecting plus, minus or digit" );
+		return error( LexerCore::E_ExpectingExponent );
 	return true;
 }
 
-bool NumberParser::error(const char *str)
+bool NumberParser::error(LexerCore::Error e)
 {
-	d_error = str;
+	d_error = e;
 	return false;
 }
 
 QChar NumberParser::lookAhead(quint32 off) const
 {
-	if( int( d_start + off ) < d_str.size() )
-		return d_str[ d_start + off ];
-	else
+	if( int( d_start + off ) < d_len )
+	{
+		if( d_str )
+			return d_str[ d_start + off ];
+		else
+			return QChar( ushort( uchar( d_bytes[ d_start + off ] ) ) );
+	}else
 		return QChar();
 }
 
+Lexer::Lexer(QObject *parent) :
+	QObject(parent), d_in(0),d_ownsStream(false)
+{
+}
+
+Lexer::~Lexer()
+{
+	if( d_in && d_ownsStream )
+		delete d_in;
+}
+
+void Lexer::setStream(QTextStream *in, bool haveOwnership )
+{
+	if( d_in != 0 && d_ownsStream )
+		delete d_in;
+	d_in = in;
+	d_ownsStream = haveOwnership;
+	d_text.clear();
+	LexerCore::setBuffer( 0, 0 );
+	reset();
+}
 
+void Lexer::setBuffer(const QChar* begin, const QChar* end)
+{
+	if( d_in != 0 && d_ownsStream )
+		delete d_in;
+	d_in = 0;
+	d_ownsStream = false;
+	d_text.clear();
+	LexerCore::setBuffer( begin, end );
+}
 
+void Lexer::reset()
+{
+	if( d_in )
+	{
+		d_in->seek(0);
+		d_in->reset();
+		d_in->resetStatus();
+		// the stream is read at once and then lexed like a buffer
+		d_text = d_in->readAll();
+		LexerCore::setBuffer( d_text.constData(), d_text.constData() + d_text.size() );
+	}else
+		LexerCore::reset();
+}
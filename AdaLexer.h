@@ -27,7 +27,11 @@ class QTextStream;
 
 namespace Ada
 {
-	class Lexer : public QObject
+	class TokenStore;
+
+	// Plain lexer without QObject and translations; a LexerCore only depends on its buffer, so any
+	// number of them can be used in parallel threads.
+	class LexerCore
 	{
 	public:
 		enum TokenType { // Ada 2012
@@ -67,32 +71,70 @@ namespace Ada
 			T_Comment,              // -- to EOL
 			T_EOF
 		};
+		enum Error { E_None,
+			E_UnexpectedChar, E_NonTerminatedString,
+			E_ExpectingDigit, E_ExpectingExtDigit, E_ExpectingHash, E_ExpectingExponent
+		};
 		struct Token
 		{
 			quint8 d_type;
-			quint16 d_line;
-			quint16 d_col, d_len;
-			QString d_val;
-			Token(TokenType t = T_EOF, quint32 line = 0, quint16 col = 0, quint16 len = 0, const QString& val = QString() ):
-				d_type(t),d_line(line),d_col(col),d_len(len),d_val(val){}
+			quint32 d_line;
+			quint32 d_col, d_len;
+			quint32 d_off;      // offset of the token from the start of the buffer
+			const QChar* d_src; // first char of the token in the source buffer
+			quint8 d_err;       // Error of T_Invalid tokens, otherwise E_None
+			Token(TokenType t = T_EOF, quint32 line = 0, quint32 col = 0, quint32 len = 0, quint32 off = 0,
+				  const QChar* src = 0, Error err = E_None ):
+				d_type(t),d_line(line),d_col(col),d_len(len),d_off(off),d_src(src),d_err(err){}
+			QString getString() const; // value of the token, created on demand from d_src
+			QString getError() const; // translated error message
 			bool isValid() const { return d_type != T_EOF && d_type != T_Invalid; }
 			bool isEof() const { return d_type == T_EOF; }
-			const char* getName() const { return Lexer::tokenName( d_type ); }
-			bool isKeyWord() const { return Lexer::isKeyWord( d_type ); }
-			bool isDelimiter() const { return Lexer::isDelimiter( d_type ); }
-			bool isNumber() const { return Lexer::isNumber( d_type ); }
+			const char* getName() const { return LexerCore::tokenName( d_type ); }
+			bool isKeyWord() const { return LexerCore::isKeyWord( d_type ); }
+			bool isDelimiter() const { return LexerCore::isDelimiter( d_type ); }
+			bool isNumber() const { return LexerCore::isNumber( d_type ); }
 			bool isString() const { return d_type == T_String || d_type == T_Character; }
 			bool isIdent() const { return d_type == T_Identifier; }
 			bool isAttr() const { return d_type == T_Attribute; }
 			bool isComment() const { return d_type == T_Comment; }
 		};
 
-		explicit Lexer(QObject *parent = 0);
-		~Lexer();
+		LexerCore();
 
-		void setStream( QTextStream* in, bool haveOwnership = false );
+		void setBuffer( const QChar* begin, const QChar* end ); // buffer must stay unchanged while lexing
 		void reset();
 		Token nextToken();
+		int tokenize( TokenStore& ); // replaces the contents of the store by the remaining tokens up to EOF
+		// State carried over from the previous line when lines are lexed separately, i.e. whether the last
+		// token before the comments was a tick; 0 or 1, call setState() after setBuffer()
+		int getState() const { return d_lastTokenType == T_Tick; }
+		void setState( int s ) { d_lastTokenType = ( s == 1 ) ? T_Tick : T_Invalid; }
+
+		// Incremental re-lexing of a TokenStore after an edit of its source. The buffer is a piece of the
+		// source after the edit which starts at line 'line' at offset 'off', not after the edit, and
+		// ends at a line end; atEnd if it ends with the source. Lexing stops as soon as the new tokens
+		// line up with the old ones again. The tokens [d_first, d_first + d_removed) of the store were
+		// replaced by d_inserted new ones; d_first is -1 and the store unchanged if the buffer was too
+		// short to line up.
+		struct Edit
+		{
+			quint32 d_pos;
+			quint32 d_removed;
+			quint32 d_inserted;
+			Edit( quint32 pos = 0, quint32 removed = 0, quint32 inserted = 0 ):
+				d_pos(pos),d_removed(removed),d_inserted(inserted){}
+		};
+		struct Delta
+		{
+			int d_first;
+			int d_removed;
+			int d_inserted;
+			Delta( int first = -1, int removed = 0, int inserted = 0 ):
+				d_first(first),d_removed(removed),d_inserted(inserted){}
+		};
+		static Delta relex( TokenStore&, const Edit&, const QChar* begin, const QChar* end,
+							quint32 off, quint32 line, bool atEnd );
 
 		static bool isAda83KeyWord( quint8 type );
 		static bool isAda95KeyWord( quint8 type );
@@ -103,29 +145,68 @@ namespace Ada
 		static bool isNumber( quint8 type );
 		static const char* tokenName( quint8 type, bool asSymbol = false );
 		static TokenType findReservedWord( const QString& );
+		static TokenType findReservedWord( const QChar* str, int len );
+		static TokenType findReservedWord( const char* str, int len ); // Latin-1 or UTF-8
+		static const char* errorText( quint8 error ); // untranslated
+		static QString errorMessage( quint8 error, QChar ch = QChar() ); // ch is reported by E_UnexpectedChar
+
+		// Classification of UTF-16 code units; ASCII by table, the rest by QChar
+		enum CharClass { C_Space = 1, C_Letter = 2, C_Digit = 4, C_Ident = 8, C_ExtDigit = 16, C_Print = 32 };
+		static bool isSpaceChar( ushort ch )
+			{ return ( ch < 128 ) ? ( s_charClass[ch] & C_Space ) : QChar( ch ).isSpace(); }
+		static bool isLetterChar( ushort ch )
+			{ return ( ch < 128 ) ? ( s_charClass[ch] & C_Letter ) : QChar( ch ).isLetter(); }
+		static bool isDigitChar( ushort ch )
+			{ return ( ch < 128 ) ? ( s_charClass[ch] & C_Digit ) : QChar( ch ).isDigit(); }
+		static bool isIdentChar( ushort ch ) // letter, digit or underscore
+			{ return ( ch < 128 ) ? ( s_charClass[ch] & C_Ident ) : QChar( ch ).isLetterOrNumber(); }
+		static bool isExtDigitChar( ushort ch ) // digit or A..F, a..f
+			{ return ( ch < 128 ) ? ( s_charClass[ch] & C_ExtDigit ) : QChar( ch ).isDigit(); }
+		static bool isPrintChar( ushort ch )
+			{ return ( ch < 128 ) ? ( s_charClass[ch] & C_Print ) : QChar( ch ).isPrint(); }
 	protected:
 		void nextLine();
 		void skipWhiteSpace();
 		char lookAhead( quint32 ) const;
 		QChar lookAhead2( quint32 ) const;
-		Token token( TokenType, int len = 1, const QString& val = QString() );
+		Token token( TokenType, int len = 1, Error err = E_None );
 		Token string();
 		Token ident();
 		Token numeric();
 	private:
-		QTextStream* d_in;
-		quint16 d_lineNr; // current line, starting with 1
-		quint16 d_colNr;  // current column (left of char), starting with 0
-		QString d_line;
+		const QChar* d_begin; // the buffer being lexed
+		const QChar* d_end;
+		const QChar* d_cur;   // start of the next line
+		const QChar* d_line;  // current line in the buffer, without line terminator
+		quint32 d_lineLen;
+		quint32 d_lineNr; // current line, starting with 1
+		quint32 d_colNr;  // current column (left of char), starting with 0
 		quint8 d_lastTokenType;
+		static const quint8 s_charClass[128];
+	};
+
+	// Compatibility wrapper which adds QObject and QTextStream input
+	class Lexer : public QObject, public LexerCore
+	{
+	public:
+		explicit Lexer(QObject *parent = 0);
+		~Lexer();
+
+		void setStream( QTextStream* in, bool haveOwnership = false );
+		void setBuffer( const QChar* begin, const QChar* end );
+		void reset();
+	private:
+		QTextStream* d_in;
+		QString d_text;       // contents of d_in
 		bool d_ownsStream;
 	};
 
 	class NumberParser
 	{
 	public:
-		NumberParser( const QString&, int start );
-		const QByteArray& getError() const { return d_error; }
+		NumberParser( const QChar* str, int len, int start );
+		NumberParser( const char* str, int len, int start ); // bytes are taken as Latin-1
+		LexerCore::Error getError() const { return d_error; }
 		bool parse();
 		int getOff() const { return d_off; }
 		bool hasDecimals() const { return d_hasDecimals; }
@@ -136,10 +217,12 @@ namespace Ada
 		bool numeral();
 		bool basedNumeral();
 		bool exponent();
-		bool error( const char* );
+		bool error( LexerCore::Error );
 	private:
-		QByteArray d_error;
-		const QString d_str;
+		LexerCore::Error d_error;
+		const QChar* d_str;
+		const char* d_bytes;
+		const int d_len;
 		const int d_start;
 		int d_off;
 		bool d_hasDecimals;
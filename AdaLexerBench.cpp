@@ -0,0 +1,859 @@
+/*
+* Copyright 2012-2017 Rochus Keller <mailto:me@rochus-keller.info>
+*
+* This file is part of the AdaViewer application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.info.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+// Standalone throughput benchmark of the lexers; see usage() for the options. The corpus is generated
+// deterministically from a seed, so runs on different machines or revisions lex the same text.
+// AdaLexerBench.pro builds it with QtCore only; AdaHighlightBench.pro defines ADA_BENCH_HIGHLIGHT and
+// adds the Highlighter and QtGui for -highlight.
+
+#include "AdaLexer.h"
+#include "AdaByteLexer.h"
+#include "AdaTokenStore.h"
+#include "AdaScanKernels.h"
+#ifdef ADA_BENCH_HIGHLIGHT
+#include "AdaHighlighter.h"
+#include <QApplication>
+#include <QTextDocument>
+#else
+#include <QCoreApplication>
+#endif
+#include <QScopedPointer>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QTextStream>
+#include <QVector>
+#include <QFile>
+#include <QtAlgorithms>
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#ifdef Q_OS_LINUX
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <string.h>
+#endif
+using namespace Ada;
+
+//// Allocation counting
+
+static quint64 s_allocCount = 0;
+static quint64 s_allocBytes = 0;
+
+#ifdef __GLIBC__
+// Replacing malloc also catches the allocations of QString, QVector and QByteArray, which do not use
+// operator new; the executable's definitions take precedence over the ones of libc for all libraries.
+extern "C"
+{
+	void* __libc_malloc( size_t ) __THROW;
+	void* __libc_calloc( size_t, size_t ) __THROW;
+	void* __libc_realloc( void*, size_t ) __THROW;
+
+	void* malloc( size_t size ) __THROW
+	{
+		s_allocCount++;
+		s_allocBytes += size;
+		return __libc_malloc( size );
+	}
+
+	void* calloc( size_t n, size_t size ) __THROW
+	{
+		s_allocCount++;
+		s_allocBytes += n * size;
+		return __libc_calloc( n, size );
+	}
+
+	void* realloc( void* ptr, size_t size ) __THROW
+	{
+		s_allocCount++;
+		s_allocBytes += size;
+		return __libc_realloc( ptr, size );
+	}
+}
+#else
+// Only operator new can be counted portably
+void* operator new( size_t size )
+{
+	s_allocCount++;
+	s_allocBytes += size;
+	void* p = ::malloc( size );
+	if( p == 0 )
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete( void* p )
+{
+	::free( p );
+}
+
+void* operator new[]( size_t size )
+{
+	return operator new( size );
+}
+
+void operator delete[]( void* p )
+{
+	::free( p );
+}
+#endif
+
+//// Hardware counters
+
+enum PerfCounter { PC_Cycles, PC_Instructions, PC_CacheMisses, PC_BranchMisses, PC_Max };
+static const char* s_perfName[PC_Max] = { "cycles", "instructions", "cache_misses", "branch_misses" };
+
+class PerfCounters
+{
+public:
+	PerfCounters()
+	{
+		for( int i = 0; i < PC_Max; i++ )
+		{
+			d_fd[i] = -1;
+			d_value[i] = 0;
+		}
+#ifdef Q_OS_LINUX
+		static const quint64 config[PC_Max] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+												PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+		for( int i = 0; i < PC_Max; i++ )
+		{
+			perf_event_attr attr;
+			::memset( &attr, 0, sizeof(attr) );
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.size = sizeof(attr);
+			attr.config = config[i];
+			attr.disabled = 1;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			// fails without PMU access, e.g. in VMs or with perf_event_paranoid > 2
+			d_fd[i] = ::syscall( __NR_perf_event_open, &attr, 0, -1, -1, 0 );
+		}
+#endif
+	}
+	~PerfCounters()
+	{
+#ifdef Q_OS_LINUX
+		for( int i = 0; i < PC_Max; i++ )
+			if( d_fd[i] != -1 )
+				::close( d_fd[i] );
+#endif
+	}
+	bool isAvailable() const
+	{
+		for( int i = 0; i < PC_Max; i++ )
+			if( d_fd[i] != -1 )
+				return true;
+		return false;
+	}
+	bool has( int i ) const { return d_fd[i] != -1; }
+	quint64 value( int i ) const { return d_value[i]; }
+	void start()
+	{
+#ifdef Q_OS_LINUX
+		for( int i = 0; i < PC_Max; i++ )
+		{
+			if( d_fd[i] == -1 )
+				continue;
+			::ioctl( d_fd[i], PERF_EVENT_IOC_RESET, 0 );
+			::ioctl( d_fd[i], PERF_EVENT_IOC_ENABLE, 0 );
+		}
+#endif
+	}
+	void stop()
+	{
+#ifdef Q_OS_LINUX
+		for( int i = 0; i < PC_Max; i++ )
+		{
+			if( d_fd[i] == -1 )
+				continue;
+			::ioctl( d_fd[i], PERF_EVENT_IOC_DISABLE, 0 );
+			quint64 v = 0;
+			if( ::read( d_fd[i], &v, sizeof(v) ) == sizeof(v) )
+				d_value[i] = v;
+			else
+				d_value[i] = 0;
+		}
+#endif
+	}
+private:
+	int d_fd[PC_Max];
+	quint64 d_value[PC_Max];
+};
+
+//// Corpus generator
+
+// Own generator instead of qrand(), so the corpus does not depend on the C library
+class Random
+{
+public:
+	Random( quint64 seed ):d_state( seed * 2862933555777941757ULL + 3037000493ULL ) {}
+	quint32 next( quint32 n )
+	{
+		d_state = d_state * 6364136223846793005ULL + 1442695040888963407ULL;
+		return quint32( d_state >> 33 ) % n;
+	}
+	bool chance( quint32 percent ) { return next( 100 ) < percent; }
+private:
+	quint64 d_state;
+};
+
+enum Profile { P_Mixed, P_Nested, P_Comments, P_Literals };
+static const char* s_profileName[] = { "mixed", "nested", "comments", "literals", 0 };
+
+static const char* s_words[] = { "Count", "Index", "Buffer", "Item", "Node", "Result", "Value", "Next", "Left",
+	"Right", "Size", "Offset", "Queue", "Table", "Cursor", "Element", "State", "Handler", "Stream", "Key", 0 };
+static const char* s_attrs[] = { "Length", "First", "Last", "Range", "Image", "Access", "Size", "Pos", 0 };
+static const char* s_text[] = { "the", "value", "is", "checked", "before", "each", "call", "and", "after",
+	"return", "of", "buffer", "loop", "invariant", "holds", "for", "all", "elements", "in", "range", 0 };
+
+class CorpusGenerator
+{
+public:
+	CorpusGenerator( quint64 seed, Profile p ):d_rand(seed),d_profile(p),d_lines(0),d_id(0) {}
+	QByteArray generate( int lines )
+	{
+		d_out.clear();
+		d_out.reserve( lines * 40 );
+		d_lines = 0;
+		line( 0, "with Ada.Text_IO; use Ada.Text_IO;" );
+		while( d_lines < lines )
+		{
+			if( d_profile == P_Comments || d_rand.chance( 20 ) )
+				commentBlock( 0 );
+			package( lines );
+		}
+		return d_out;
+	}
+protected:
+	void line( int indent, const QByteArray& text )
+	{
+		d_out.append( QByteArray( indent, '\t' ) );
+		d_out.append( text );
+		d_out.append( '\n' );
+		d_lines++;
+	}
+	QByteArray word( const char** list )
+	{
+		int n = 0;
+		while( list[n] )
+			n++;
+		return list[ d_rand.next( n ) ];
+	}
+	QByteArray name()
+	{
+		return word( s_words ) + '_' + QByteArray::number( d_rand.next( 100 ) );
+	}
+	QByteArray number()
+	{
+		switch( d_rand.next( ( d_profile == P_Literals ) ? 7 : 4 ) )
+		{
+		case 0:
+			return QByteArray::number( d_rand.next( 1000 ) );
+		case 1:
+			return QByteArray::number( d_rand.next( 1000 ) ) + '_' + QByteArray::number( 100 + d_rand.next( 900 ) );
+		case 2:
+			return QByteArray::number( d_rand.next( 100 ) ) + '.' + QByteArray::number( d_rand.next( 1000 ) ) +
+					"E-" + QByteArray::number( d_rand.next( 10 ) );
+		case 3:
+			return "16#" + QByteArray::number( d_rand.next( 0xffff ), 16 ).toUpper() + "_FF#";
+		case 4:
+			return "2#1010_" + QByteArray::number( d_rand.next( 256 ), 2 ) + "#E+" + QByteArray::number( d_rand.next( 8 ) );
+		case 5:
+			return "8#" + QByteArray::number( d_rand.next( 4096 ), 8 ) + '.' + QByteArray::number( d_rand.next( 64 ), 8 ) + '#';
+		default:
+			return "16#" + QByteArray::number( d_rand.next( 0xffff ), 16 ) + ".A#E" + QByteArray::number( d_rand.next( 4 ) );
+		}
+	}
+	QByteArray operand()
+	{
+		switch( d_rand.next( ( d_profile == P_Literals ) ? 6 : 8 ) )
+		{
+		case 0:
+		case 1:
+			return number();
+		case 2:
+			return "\"" + word( s_text ) + " \"\"" + word( s_text ) + "\"\"\"";
+		case 3:
+			return QByteArray( "'" ) + char( 'a' + d_rand.next( 26 ) ) + '\'';
+		case 4:
+			return name() + '\'' + word( s_attrs );
+		default:
+			return name();
+		}
+	}
+	QByteArray expression()
+	{
+		static const char* ops[] = { " + ", " - ", " * ", " / ", " ** ", " & ", " mod ", " rem ", 0 };
+		QByteArray e = operand();
+		const int n = d_rand.next( 4 );
+		for( int i = 0; i < n; i++ )
+			e += word( ops ) + operand();
+		return e;
+	}
+	QByteArray condition()
+	{
+		static const char* ops[] = { " = ", " /= ", " < ", " <= ", " > ", " >= ", 0 };
+		QByteArray c = name() + word( ops ) + expression();
+		if( d_rand.chance( 30 ) )
+			c += " and then " + name() + " in 1 .. " + number();
+		return c;
+	}
+	void commentBlock( int indent )
+	{
+		const int n = ( d_profile == P_Comments ) ? 10 + d_rand.next( 60 ) : 1 + d_rand.next( 4 );
+		for( int i = 0; i < n; i++ )
+		{
+			QByteArray c = "-- ";
+			const int w = 3 + d_rand.next( 12 );
+			for( int j = 0; j < w; j++ )
+				c += word( s_text ) + ' ';
+			if( d_rand.chance( 5 ) )
+				c += "Gr\xc3\xb6\xc3\x9f" "e \xe2\x82\xac"; // some UTF-8
+			line( indent, c );
+		}
+	}
+	void statements( int indent, int depth, int maxLines )
+	{
+		const int maxDepth = ( d_profile == P_Nested ) ? 40 : 4;
+		const int n = 1 + d_rand.next( ( d_profile == P_Nested ) ? 3 : 6 );
+		for( int i = 0; i < n && d_lines < maxLines; i++ )
+		{
+			const int kind = d_rand.next( ( depth < maxDepth ) ? 6 : 3 );
+			switch( kind )
+			{
+			case 0:
+			case 1:
+				line( indent, name() + " := " + expression() + ';' );
+				break;
+			case 2:
+				line( indent, "Put_Line (" + name() + "'Image (" + operand() + "), Item => " + operand() + ");" );
+				if( d_rand.chance( 10 ) )
+					commentBlock( indent );
+				break;
+			case 3:
+				line( indent, "if " + condition() + " then" );
+				statements( indent + 1, depth + 1, maxLines );
+				if( d_rand.chance( 40 ) )
+				{
+					line( indent, "elsif " + condition() + " then" );
+					statements( indent + 1, depth + 1, maxLines );
+				}
+				line( indent, "end if;" );
+				break;
+			case 4:
+				line( indent, "for " + name() + " in reverse " + number() + " .. " + name() + "'Last loop" );
+				statements( indent + 1, depth + 1, maxLines );
+				line( indent, "end loop;" );
+				break;
+			default:
+				line( indent, "case " + name() + " is" );
+				line( indent + 1, "when " + number() + " | " + number() + " =>" );
+				statements( indent + 2, depth + 1, maxLines );
+				line( indent + 1, "when others =>" );
+				line( indent + 2, "null;" );
+				line( indent, "end case;" );
+				break;
+			}
+		}
+	}
+	void subprogram( int indent, int maxLines )
+	{
+		const QByteArray n = "Proc_" + QByteArray::number( d_id++ );
+		line( indent, "procedure " + n + " (" + name() + " : in out Integer; " + name() +
+			  " : Float := " + number() + ") is" );
+		line( indent + 1, name() + " : constant Natural := " + expression() + ';' );
+		line( indent + 1, "type Arr is array (1 .. " + number() + ") of Character;" );
+		line( indent, "begin" );
+		statements( indent + 1, 0, maxLines );
+		line( indent, "end " + n + ';' );
+	}
+	void package( int maxLines )
+	{
+		const QByteArray n = "Pack_" + QByteArray::number( d_id++ );
+		line( 0, "package body " + n + " is" );
+		const int count = 1 + d_rand.next( 8 );
+		for( int i = 0; i < count && d_lines < maxLines; i++ )
+		{
+			if( d_rand.chance( 30 ) )
+				commentBlock( 1 );
+			subprogram( 1, maxLines );
+		}
+		line( 0, "end " + n + ';' );
+	}
+private:
+	Random d_rand;
+	Profile d_profile;
+	QByteArray d_out;
+	int d_lines;
+	int d_id;
+};
+
+//// Benchmarks
+
+struct Corpus
+{
+	QByteArray d_utf8;
+	QString d_text;
+	QStringList d_words;   // identifiers and reserved words of the corpus
+	QStringList d_numbers; // numeric literals of the corpus
+	QStringList d_lines;
+	quint64 d_wordBytes;
+	quint64 d_numberBytes;
+	quint64 d_tokens;
+#ifdef ADA_BENCH_HIGHLIGHT
+	QTextDocument* d_doc; // only with -highlight
+	Highlighter* d_highlighter;
+	Corpus():d_wordBytes(0),d_numberBytes(0),d_tokens(0),d_doc(0),d_highlighter(0) {}
+	~Corpus() { delete d_doc; }
+#else
+	Corpus():d_wordBytes(0),d_numberBytes(0),d_tokens(0) {}
+#endif
+};
+
+typedef quint64 (*BenchFunc)( const Corpus& );
+
+static volatile quint64 s_sink = 0; // results of the micro benchmarks go here, so the calls are not optimized away
+
+static quint64 _benchNextToken( const Corpus& c )
+{
+	LexerCore lex;
+	lex.setBuffer( c.d_text.constData(), c.d_text.constData() + c.d_text.size() );
+	quint64 n = 0;
+	while( !lex.nextToken().isEof() )
+		n++;
+	return n;
+}
+
+static quint64 _benchTokenize( const Corpus& c )
+{
+	LexerCore lex;
+	lex.setBuffer( c.d_text.constData(), c.d_text.constData() + c.d_text.size() );
+	TokenStore store;
+	return lex.tokenize( store );
+}
+
+static quint64 _benchByteLexer( const Corpus& c )
+{
+	ByteLexer lex;
+	lex.setBuffer( c.d_utf8, ByteLexer::Utf8 );
+	TokenStore store;
+	return lex.tokenize( store );
+}
+
+static quint64 _benchStream( const Corpus& c )
+{
+	QString text = c.d_text;
+	QTextStream in( &text, QIODevice::ReadOnly );
+	Lexer lex;
+	lex.setStream( &in );
+	quint64 n = 0;
+	while( !lex.nextToken().isEof() )
+		n++;
+	lex.setStream( 0 );
+	return n;
+}
+
+static quint64 _benchLinesStream( const Corpus& c )
+{
+	// The stream setup per block the original Highlighter::highlightBlock() had; the lexer behind
+	// Lexer::setStream() is the current one, which reads the stream into a buffer, so this is not
+	// the original highlighter (see the README for that comparison).
+	Lexer lex;
+	quint64 n = 0;
+	for( int i = 0; i < c.d_lines.size(); i++ )
+	{
+		QString line = c.d_lines[i];
+		QTextStream in( &line, QIODevice::ReadOnly );
+		lex.setStream( &in );
+		while( !lex.nextToken().isEof() )
+			n++;
+		lex.setStream( 0 );
+	}
+	return n;
+}
+
+static quint64 _benchLinesBuffer( const Corpus& c )
+{
+	// what Highlighter::highlightBlock() does for each block
+	LexerCore lex;
+	TokenStore store;
+	quint64 n = 0;
+	int state = 0;
+	for( int i = 0; i < c.d_lines.size(); i++ )
+	{
+		const QString& line = c.d_lines[i];
+		lex.setBuffer( line.constData(), line.constData() + line.size() );
+		lex.setState( state );
+		n += lex.tokenize( store );
+		state = lex.getState();
+	}
+	return n;
+}
+
+#ifdef ADA_BENCH_HIGHLIGHT
+static quint64 _benchHighlight( const Corpus& c )
+{
+	c.d_highlighter->rehighlight();
+	return c.d_tokens;
+}
+#endif
+
+static quint64 _benchReservedWords( const Corpus& c )
+{
+	quint64 found = 0;
+	for( int i = 0; i < c.d_words.size(); i++ )
+	{
+		const QString& w = c.d_words[i];
+		if( LexerCore::findReservedWord( w.constData(), w.size() ) != LexerCore::T_Invalid )
+			found++;
+	}
+	s_sink += found;
+	return c.d_words.size();
+}
+
+static quint64 _benchNumberParser( const Corpus& c )
+{
+	quint64 ok = 0;
+	for( int i = 0; i < c.d_numbers.size(); i++ )
+	{
+		const QString& n = c.d_numbers[i];
+		NumberParser np( n.constData(), n.size(), 0 );
+		if( np.parse() )
+			ok++;
+	}
+	s_sink += ok;
+	return c.d_numbers.size();
+}
+
+struct Bench
+{
+	const char* d_name;
+	BenchFunc d_func;
+	int d_bytes; // 0: corpus, 1: words, 2: numbers
+	bool d_gui;  // needs -highlight
+};
+
+static const Bench s_benches[] =
+{
+	{ "LexerCore::nextToken", _benchNextToken, 0, false },
+	{ "LexerCore::tokenize", _benchTokenize, 0, false },
+	{ "ByteLexer::tokenize", _benchByteLexer, 0, false },
+	{ "Lexer::setStream", _benchStream, 0, false },
+	{ "lines:setStream", _benchLinesStream, 0, false },
+	{ "lines:setBuffer", _benchLinesBuffer, 0, false },
+#ifdef ADA_BENCH_HIGHLIGHT
+	{ "Highlighter::rehighlight", _benchHighlight, 0, true },
+#endif
+	{ "findReservedWord", _benchReservedWords, 1, false },
+	{ "NumberParser", _benchNumberParser, 2, false },
+	{ 0, 0, 0, false }
+};
+
+struct Result
+{
+	QByteArray d_name;
+	quint64 d_tokens;
+	quint64 d_bytes;
+	double d_best;
+	double d_median;
+	quint64 d_allocs;
+	quint64 d_allocBytes;
+	bool d_hasPerf;
+	quint64 d_perf[PC_Max]; // of the fastest run
+	bool d_perfValid[PC_Max];
+};
+
+static Result _run( const Bench& b, const Corpus& c, int repeat, PerfCounters& perf )
+{
+	Result r;
+	r.d_name = b.d_name;
+	r.d_bytes = ( b.d_bytes == 0 ) ? c.d_utf8.size() : ( b.d_bytes == 1 ) ? c.d_wordBytes : c.d_numberBytes;
+	r.d_hasPerf = perf.isAvailable();
+	QVector<double> times;
+	b.d_func( c ); // warm up
+	for( int i = 0; i < repeat; i++ )
+	{
+		const quint64 allocs = s_allocCount;
+		const quint64 allocBytes = s_allocBytes;
+		QElapsedTimer t;
+		perf.start();
+		t.start();
+		r.d_tokens = b.d_func( c );
+		const qint64 ns = t.nsecsElapsed();
+		perf.stop();
+		r.d_allocs = s_allocCount - allocs;
+		r.d_allocBytes = s_allocBytes - allocBytes;
+		const double s = ns / 1e9;
+		if( times.isEmpty() || s < r.d_best )
+		{
+			r.d_best = s;
+			for( int j = 0; j < PC_Max; j++ )
+			{
+				r.d_perf[j] = perf.value( j );
+				r.d_perfValid[j] = perf.has( j );
+			}
+		}
+		times.append( s );
+	}
+	qSort( times );
+	r.d_median = times[ times.size() / 2 ];
+	return r;
+}
+
+//// Output
+
+static QByteArray _jsonString( const QByteArray& str )
+{
+	QByteArray res = "\"";
+	for( int i = 0; i < str.size(); i++ )
+	{
+		const char ch = str[i];
+		if( ch == '"' || ch == '\\' )
+			res += '\\';
+		res += ch;
+	}
+	return res + '"';
+}
+
+static QByteArray _jsonNumber( double d )
+{
+	return QByteArray::number( d, 'g', 10 );
+}
+
+static QByteArray _toJson( const QList<Result>& results, const QByteArray& header )
+{
+	QByteArray out = "{\n" + header + "\t\"results\": [\n";
+	for( int i = 0; i < results.size(); i++ )
+	{
+		const Result& r = results[i];
+		out += "\t\t{\n";
+		out += "\t\t\t\"name\": " + _jsonString( r.d_name ) + ",\n";
+		out += "\t\t\t\"tokens\": " + QByteArray::number( r.d_tokens ) + ",\n";
+		out += "\t\t\t\"bytes\": " + QByteArray::number( r.d_bytes ) + ",\n";
+		out += "\t\t\t\"seconds_best\": " + _jsonNumber( r.d_best ) + ",\n";
+		out += "\t\t\t\"seconds_median\": " + _jsonNumber( r.d_median ) + ",\n";
+		out += "\t\t\t\"tokens_per_s\": " + _jsonNumber( r.d_tokens / r.d_best ) + ",\n";
+		out += "\t\t\t\"mb_per_s\": " + _jsonNumber( r.d_bytes / r.d_best / 1e6 ) + ",\n";
+		out += "\t\t\t\"allocs\": " + QByteArray::number( r.d_allocs ) + ",\n";
+		out += "\t\t\t\"alloc_bytes\": " + QByteArray::number( r.d_allocBytes ) + ",\n";
+		out += "\t\t\t\"allocs_per_token\": " + _jsonNumber( double( r.d_allocs ) / qMax( r.d_tokens, quint64(1) ) ) + ",\n";
+		out += "\t\t\t\"perf\": ";
+		if( r.d_hasPerf )
+		{
+			out += "{ ";
+			bool first = true;
+			for( int j = 0; j < PC_Max; j++ )
+			{
+				if( !r.d_perfValid[j] )
+					continue;
+				if( !first )
+					out += ", ";
+				first = false;
+				out += _jsonString( s_perfName[j] ) + ": " + QByteArray::number( r.d_perf[j] );
+			}
+			out += " }\n";
+		}else
+			out += "null\n";
+		out += ( i + 1 < results.size() ) ? "\t\t},\n" : "\t\t}\n";
+	}
+	out += "\t]\n}\n";
+	return out;
+}
+
+static void _usage()
+{
+	fprintf( stderr,
+			 "usage: AdaLexerBench [options]\n"
+			 "  -lines N       number of lines of the generated corpus (default 1000000)\n"
+			 "  -seed N        seed of the corpus generator (default 1)\n"
+			 "  -profile P     mixed, nested, comments or literals (default mixed)\n"
+			 "  -repeat N      runs per benchmark; the best and the median are reported (default 5)\n"
+			 "  -in FILE       lex the given UTF-8 file instead of a generated corpus\n"
+			 "  -corpus FILE   write the generated corpus to FILE\n"
+			 "  -out FILE      write the JSON results to FILE instead of stdout\n"
+			 "  -filter NAME   only run the benchmarks whose name contains NAME\n"
+#ifdef ADA_BENCH_HIGHLIGHT
+			 "  -highlight     also time a full rehighlight of a QTextDocument (needs a display)\n"
+#endif
+			 );
+}
+
+int main(int argc, char *argv[])
+{
+	int lines = 1000000;
+	quint64 seed = 1;
+	int profile = P_Mixed;
+	int repeat = 5;
+	bool highlight = false;
+	QString inPath, corpusPath, outPath, filter;
+	QStringList args;
+	for( int i = 0; i < argc; i++ )
+		args.append( QString::fromLocal8Bit( argv[i] ) );
+	for( int i = 1; i < args.size(); i++ )
+	{
+		const QString& arg = args[i];
+		const bool hasValue = i + 1 < args.size();
+		if( arg == "-lines" && hasValue )
+			lines = args[++i].toInt();
+		else if( arg == "-seed" && hasValue )
+			seed = args[++i].toULongLong();
+		else if( arg == "-profile" && hasValue )
+		{
+			const QByteArray p = args[++i].toLatin1();
+			profile = -1;
+			for( int j = 0; s_profileName[j]; j++ )
+				if( p == s_profileName[j] )
+					profile = j;
+			if( profile < 0 )
+			{
+				_usage();
+				return -1;
+			}
+		}else if( arg == "-repeat" && hasValue )
+			repeat = qMax( 1, args[++i].toInt() );
+		else if( arg == "-in" && hasValue )
+			inPath = args[++i];
+		else if( arg == "-corpus" && hasValue )
+			corpusPath = args[++i];
+		else if( arg == "-out" && hasValue )
+			outPath = args[++i];
+		else if( arg == "-filter" && hasValue )
+			filter = args[++i];
+#ifdef ADA_BENCH_HIGHLIGHT
+		else if( arg == "-highlight" )
+			highlight = true;
+#endif
+		else
+		{
+			_usage();
+			return -1;
+		}
+	}
+
+#ifdef ADA_BENCH_HIGHLIGHT
+	QScopedPointer<QCoreApplication> app( highlight ? new QApplication( argc, argv ) :
+										  new QCoreApplication( argc, argv ) );
+#else
+	QScopedPointer<QCoreApplication> app( new QCoreApplication( argc, argv ) );
+#endif
+
+	Corpus c;
+	if( !inPath.isEmpty() )
+	{
+		QFile in( inPath );
+		if( !in.open( QIODevice::ReadOnly ) )
+		{
+			fprintf( stderr, "cannot open %s\n", inPath.toLocal8Bit().constData() );
+			return -1;
+		}
+		c.d_utf8 = in.readAll();
+	}else
+	{
+		CorpusGenerator gen( seed, Profile( profile ) );
+		c.d_utf8 = gen.generate( lines );
+		if( !corpusPath.isEmpty() )
+		{
+			QFile out( corpusPath );
+			if( !out.open( QIODevice::WriteOnly ) )
+			{
+				fprintf( stderr, "cannot write %s\n", corpusPath.toLocal8Bit().constData() );
+				return -1;
+			}
+			out.write( c.d_utf8 );
+		}
+	}
+	c.d_text = QString::fromUtf8( c.d_utf8 );
+
+	c.d_lines = c.d_text.split( QLatin1Char('\n') );
+#ifdef ADA_BENCH_HIGHLIGHT
+	if( highlight )
+	{
+		c.d_doc = new QTextDocument();
+		c.d_doc->setPlainText( c.d_text );
+		c.d_highlighter = new Highlighter( c.d_doc );
+	}
+#endif
+
+	// inputs of the micro benchmarks, collected from the corpus
+	{
+		LexerCore lex;
+		lex.setBuffer( c.d_text.constData(), c.d_text.constData() + c.d_text.size() );
+		LexerCore::Token t = lex.nextToken();
+		while( !t.isEof() )
+		{
+			c.d_tokens++;
+			if( t.d_type == LexerCore::T_Identifier || LexerCore::isKeyWord( t.d_type ) )
+			{
+				c.d_words.append( QString( t.d_src, t.d_len ) );
+				c.d_wordBytes += t.d_len;
+			}else if( t.d_type == LexerCore::T_Number )
+			{
+				c.d_numbers.append( QString( t.d_src, t.d_len ) );
+				c.d_numberBytes += t.d_len;
+			}
+			t = lex.nextToken();
+		}
+	}
+
+	PerfCounters perf;
+	if( !perf.isAvailable() )
+		fprintf( stderr, "hardware counters not available\n" );
+	QList<Result> results;
+	for( int i = 0; s_benches[i].d_name; i++ )
+	{
+		if( !filter.isEmpty() && !QString::fromLatin1( s_benches[i].d_name ).contains( filter ) )
+			continue;
+		if( s_benches[i].d_gui && !highlight )
+			continue;
+		const Result r = _run( s_benches[i], c, repeat, perf );
+		fprintf( stderr, "%-22s %12.0f tokens/s %9.1f MB/s %8.3f allocs/token\n", r.d_name.constData(),
+				 r.d_tokens / r.d_best, r.d_bytes / r.d_best / 1e6, double( r.d_allocs ) / qMax( r.d_tokens, quint64(1) ) );
+		results.append( r );
+	}
+
+	QByteArray header;
+	header += "\t\"benchmark\": \"AdaLexerBench\",\n";
+	header += "\t\"qt\": " + _jsonString( qVersion() ) + ",\n";
+	header += "\t\"kernel\": " + _jsonString( ScanKernels::getKernelName() ) + ",\n";
+	if( inPath.isEmpty() )
+	{
+		header += "\t\"profile\": " + _jsonString( s_profileName[profile] ) + ",\n";
+		header += "\t\"seed\": " + QByteArray::number( seed ) + ",\n";
+	}else
+		header += "\t\"input\": " + _jsonString( inPath.toUtf8() ) + ",\n";
+	header += "\t\"lines\": " + QByteArray::number( c.d_utf8.count( '\n' ) ) + ",\n";
+	header += "\t\"bytes\": " + QByteArray::number( c.d_utf8.size() ) + ",\n";
+	header += "\t\"repeat\": " + QByteArray::number( repeat ) + ",\n";
+	const QByteArray json = _toJson( results, header );
+	if( outPath.isEmpty() )
+		fwrite( json.constData(), 1, json.size(), stdout );
+	else
+	{
+		QFile out( outPath );
+		if( !out.open( QIODevice::WriteOnly ) )
+		{
+			fprintf( stderr, "cannot write %s\n", outPath.toLocal8Bit().constData() );
+			return -1;
+		}
+		out.write( json );
+	}
+	return 0;
+}
@@ -0,0 +1,28 @@
+QT       += core
+QT       -= gui
+
+TARGET = AdaLexerBench
+CONFIG   += console
+CONFIG   -= app_bundle
+TEMPLATE = app
+
+	DESTDIR = ./tmp
+	OBJECTS_DIR = ./tmp-bench
+	CONFIG(debug, debug|release) {
+		DESTDIR = ./tmp-dbg
+		OBJECTS_DIR = ./tmp-bench-dbg
+		DEFINES += _DEBUG
+	}
+
+SOURCES += \
+    AdaLexerBench.cpp \
+    AdaLexer.cpp \
+    AdaByteLexer.cpp \
+    AdaTokenStore.cpp \
+    AdaScanKernels.cpp
+
+HEADERS += \
+    AdaLexer.h \
+    AdaByteLexer.h \
+    AdaTokenStore.h \
+    AdaScanKernels.h
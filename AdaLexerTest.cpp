@@ -0,0 +1,248 @@
+/*
+* Copyright 2012-2017 Rochus Keller <mailto:me@rochus-keller.info>
+*
+* This file is part of the AdaViewer application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.info.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+// Checks that LexerCore::findReservedWord() finds each reserved word, and LexerCore::relex() and
+// TokenStore::replace() against a full lexing of the text after each of a series of random edits;
+// exits with 1 at the first difference. Run AdaLexerTest -h for the options.
+
+#include "AdaLexer.h"
+#include "AdaTokenStore.h"
+#include <QCoreApplication>
+#include <QStringList>
+#include <QByteArray>
+#include <stdio.h>
+using namespace Ada;
+
+// Pieces of text the edits insert; they open and close strings and comments, end lines with a tick
+// and split tokens when inserted within one.
+static const char* s_pieces[] =
+{
+	"\n", "\n\n", "\"", "\"\"", "--", "-- comment\n", "'", "'a'", "'\"'", "X'First", "Character'('a')",
+	"\"text\"", "\"with \"\" quote\"", "begin", "end Foo;", "Foo", " ", "\t", ":= 16#FF#", "1.0E+3", "..",
+	"=>", "<>", "(", ")", ";", "procedure Bar is\n", "A'\n", "-", "#", "E", "1_0", 0
+};
+
+static const char* s_lines[] =
+{
+	"with Ada.Text_IO; use Ada.Text_IO;",
+	"procedure Main is",
+	"   S : constant String := \"abc\"\"def\"; -- a string",
+	"   C : Character := 'x';",
+	"   N : Integer := 16#FF# + 1_000 + 2#1010#E2;",
+	"   F : Float := 3.14_15E-2;",
+	"begin",
+	"   Put_Line( S & Character'Image( C ) ); -- comment with \"quotes\" and 'ticks'",
+	"   for I in A'First .. A'Last loop null; end loop;",
+	"   X := Character'('a');",
+	"end Main;",
+	0
+};
+
+// Linear congruential generator, so the edits only depend on the seed
+class Random
+{
+public:
+	Random( quint64 seed ):d_state(seed){}
+	int next( int n ) // 0 <= result < n
+	{
+		d_state = d_state * 6364136223846793005ULL + 1442695040888963407ULL;
+		return int( ( d_state >> 33 ) % quint64( qMax( n, 1 ) ) );
+	}
+private:
+	quint64 d_state;
+};
+
+static int _lineStart( const QString& text, int pos )
+{
+	while( pos > 0 && text[pos - 1] != QLatin1Char('\n') )
+		pos--;
+	return pos;
+}
+
+static int _lineNr( const QString& text, int pos ) // starting with 1
+{
+	int nr = 1;
+	for( int i = 0; i < pos; i++ )
+		if( text[i] == QLatin1Char('\n') )
+			nr++;
+	return nr;
+}
+
+static void _relex( TokenStore& tokens, const QString& text, const LexerCore::Edit& e )
+{
+	// like Highlighter::relexTokens(): whole lines from the one of the edit, with more lines after
+	// the edit as long as the new tokens do not line up with the old ones
+	const int start = _lineStart( text, e.d_pos );
+	const int line = _lineNr( text, start );
+	int more = 2;
+	forever
+	{
+		int end = e.d_pos + e.d_inserted;
+		int after = 0;
+		while( end < text.size() && after <= more )
+		{
+			if( text[end] == QLatin1Char('\n') )
+				after++;
+			end++;
+		}
+		const bool atEnd = end == text.size();
+		const LexerCore::Delta d = LexerCore::relex( tokens, e, text.constData() + start,
+													 text.constData() + end, start, line, atEnd );
+		if( d.d_first != -1 )
+			return;
+		Q_ASSERT( !atEnd );
+		more *= 2;
+	}
+}
+
+static bool _compare( const TokenStore& lhs, const TokenStore& rhs, int& at )
+{
+	at = 0;
+	for( ; at < lhs.getCount() && at < rhs.getCount(); at++ )
+	{
+		if( lhs.getType( at ) != rhs.getType( at ) || lhs.getOffset( at ) != rhs.getOffset( at ) ||
+				lhs.getLength( at ) != rhs.getLength( at ) || lhs.getLine( at ) != rhs.getLine( at ) ||
+				lhs.getCol( at ) != rhs.getCol( at ) )
+			return false;
+	}
+	return lhs.getCount() == rhs.getCount();
+}
+
+static bool _checkReservedWords()
+{
+	// every reserved word has its own slot in the perfect hash, in any case, and only the word itself
+	for( int tt = LexerCore::T_abort; tt <= LexerCore::T_xor; tt++ )
+	{
+		const QByteArray word = LexerCore::tokenName( tt );
+		const QByteArray upper = word.toUpper();
+		if( LexerCore::findReservedWord( word.constData(), word.size() ) != tt ||
+				LexerCore::findReservedWord( upper.constData(), upper.size() ) != tt ||
+				LexerCore::findReservedWord( QString::fromLatin1( word.constData(), word.size() ) ) != tt )
+		{
+			printf( "reserved word %s not found\n", word.constData() );
+			return false;
+		}
+		const QByteArray longer = word + "x";
+		if( LexerCore::findReservedWord( longer.constData(), longer.size() ) != LexerCore::T_Invalid ||
+				LexerCore::findReservedWord( word.constData(), word.size() - 1 ) == tt )
+		{
+			printf( "reserved word %s found for another word\n", word.constData() );
+			return false;
+		}
+	}
+	return true;
+}
+
+static void _print( const char* what, const TokenStore& tokens, int i )
+{
+	if( i < tokens.getCount() )
+		printf( "  %s: %s at line %u col %u, offset %u, length %u\n", what,
+				LexerCore::tokenName( tokens.getType( i ) ), tokens.getLine( i ), tokens.getCol( i ),
+				tokens.getOffset( i ), tokens.getLength( i ) );
+	else
+		printf( "  %s: no token, count %d\n", what, tokens.getCount() );
+}
+
+static void _usage()
+{
+	printf( "AdaLexerTest [-seed n] [-edits n] [-lines n]\n"
+			"  -seed n   start of the random sequence of edits (default 1)\n"
+			"  -edits n  number of edits (default 20000)\n"
+			"  -lines n  lines of the initial text (default 200)\n" );
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app( argc, argv );
+	quint64 seed = 1;
+	int edits = 20000;
+	int lines = 200;
+	const QStringList args = app.arguments();
+	for( int i = 1; i < args.size(); i++ )
+	{
+		const QString& arg = args[i];
+		const bool hasValue = i + 1 < args.size();
+		if( arg == "-seed" && hasValue )
+			seed = args[++i].toULongLong();
+		else if( arg == "-edits" && hasValue )
+			edits = args[++i].toInt();
+		else if( arg == "-lines" && hasValue )
+			lines = args[++i].toInt();
+		else
+		{
+			_usage();
+			return -1;
+		}
+	}
+
+	if( !_checkReservedWords() )
+		return 1;
+
+	int lineCount = 0;
+	while( s_lines[lineCount] )
+		lineCount++;
+	int pieceCount = 0;
+	while( s_pieces[pieceCount] )
+		pieceCount++;
+
+	Random rnd( seed );
+	QString text;
+	for( int i = 0; i < lines; i++ )
+	{
+		text += QLatin1String( s_lines[ rnd.next( lineCount ) ] );
+		if( i + 1 < lines )
+			text += QLatin1Char('\n');
+	}
+	TokenStore tokens;
+	LexerCore lex;
+	lex.setBuffer( text.constData(), text.constData() + text.size() );
+	lex.tokenize( tokens );
+	const int size = text.size();
+
+	for( int n = 0; n < edits; n++ )
+	{
+		// every eighth edit is at the end of the text; removals may span several lines and are the
+		// more likely the longer the text is, so it keeps about its initial size
+		const int pos = ( rnd.next( 8 ) == 0 ) ? text.size() - rnd.next( 3 ) : rnd.next( text.size() + 1 );
+		const int at = qBound( 0, pos, text.size() );
+		const int removed = qMin( rnd.next( text.size() + 1 ) > size / 2 ? rnd.next( 40 ) : 0, text.size() - at );
+		QString inserted;
+		if( removed == 0 || rnd.next( 2 ) == 0 )
+			inserted = QLatin1String( s_pieces[ rnd.next( pieceCount ) ] );
+
+		text.replace( at, removed, inserted );
+		const LexerCore::Edit e( at, removed, inserted.size() );
+		_relex( tokens, text, e );
+
+		TokenStore full;
+		lex.setBuffer( text.constData(), text.constData() + text.size() );
+		lex.tokenize( full );
+		int diff;
+		if( !_compare( tokens, full, diff ) )
+		{
+			printf( "edit %d of seed %llu (at %d, removed %d, inserted \"%s\") differs from full lexing "
+					"at token %d\n", n, seed, at, removed, inserted.toLatin1().constData(), diff );
+			_print( "relexed", tokens, diff );
+			_print( "full", full, diff );
+			return 1;
+		}
+	}
+	printf( "%d edits ok, %d tokens at the end\n", edits, tokens.getCount() );
+	return 0;
+}
@@ -0,0 +1,26 @@
+QT       += core
+QT       -= gui
+
+TARGET = AdaLexerTest
+CONFIG   += console
+CONFIG   -= app_bundle
+TEMPLATE = app
+
+	DESTDIR = ./tmp
+	OBJECTS_DIR = ./tmp-test
+	CONFIG(debug, debug|release) {
+		DESTDIR = ./tmp-dbg
+		OBJECTS_DIR = ./tmp-test-dbg
+		DEFINES += _DEBUG
+	}
+
+SOURCES += \
+    AdaLexerTest.cpp \
+    AdaLexer.cpp \
+    AdaTokenStore.cpp \
+    AdaScanKernels.cpp
+
+HEADERS += \
+    AdaLexer.h \
+    AdaTokenStore.h \
+    AdaScanKernels.h
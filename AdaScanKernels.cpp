@@ -0,0 +1,277 @@
+/*
+* Copyright 2012-2017 Rochus Keller <mailto:me@rochus-keller.info>
+*
+* This file is part of the AdaViewer application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.info.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "AdaScanKernels.h"
+#include <stdlib.h>
+#include <string.h>
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+#define ADA_SCAN_X86
+#define ADA_SCAN_TARGET(t) __attribute__((target(t)))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && ( defined(_M_X64) || defined(_M_AMD64) )
+#define ADA_SCAN_X86
+#define ADA_SCAN_TARGET(t)
+#include <intrin.h>
+#endif
+using namespace Ada;
+
+struct _Kernels
+{
+	const ushort* (*skipAsciiSpace)( const ushort*, const ushort* );
+	const ushort* (*findNewline)( const ushort*, const ushort* );
+	const ushort* (*findStringStop)( const ushort*, const ushort* );
+	const char* name;
+};
+
+static inline bool _isAsciiSpace( ushort ch )
+{
+	return ch == ' ' || ( ch >= 9 && ch <= 13 );
+}
+
+static inline bool _isStringStop( ushort ch )
+{
+	return ch == '"' || ch < 0x20 || ch > 0x7e;
+}
+
+static const ushort* _skipAsciiSpaceScalar( const ushort* p, const ushort* end )
+{
+	while( p < end && _isAsciiSpace( *p ) )
+		p++;
+	return p;
+}
+
+static const ushort* _findNewlineScalar( const ushort* p, const ushort* end )
+{
+	while( p < end && *p != '\n' )
+		p++;
+	return p;
+}
+
+static const ushort* _findStringStopScalar( const ushort* p, const ushort* end )
+{
+	while( p < end && !_isStringStop( *p ) )
+		p++;
+	return p;
+}
+
+#ifdef ADA_SCAN_X86
+
+// The vector versions compare 8 (SSE2) or 16 (AVX2) characters at once and turn the comparison into a bit
+// mask with two bits per character; the remaining characters are done by the scalar versions.
+
+static inline int _firstBit( quint32 mask )
+{
+#ifdef _MSC_VER
+	unsigned long i;
+	_BitScanForward( &i, mask );
+	return i;
+#else
+	return __builtin_ctz( mask );
+#endif
+}
+
+ADA_SCAN_TARGET("sse2") static const ushort* _skipAsciiSpaceSse2( const ushort* p, const ushort* end )
+{
+	const __m128i blank = _mm_set1_epi16( ' ' );
+	const __m128i tab = _mm_set1_epi16( 9 );
+	const __m128i four = _mm_set1_epi16( 4 );
+	const __m128i zero = _mm_setzero_si128();
+	while( end - p >= 8 )
+	{
+		const __m128i x = _mm_loadu_si128( reinterpret_cast<const __m128i*>( p ) );
+		// 0x09..0x0d: x - 9 <= 4 unsigned, i.e. the saturated x - 9 - 4 is zero
+		const __m128i ws = _mm_or_si128( _mm_cmpeq_epi16( x, blank ),
+										 _mm_cmpeq_epi16( _mm_subs_epu16( _mm_sub_epi16( x, tab ), four ), zero ) );
+		const quint32 mask = quint32( _mm_movemask_epi8( ws ) ) ^ 0xffffu;
+		if( mask != 0 )
+			return p + ( _firstBit( mask ) >> 1 );
+		p += 8;
+	}
+	return _skipAsciiSpaceScalar( p, end );
+}
+
+ADA_SCAN_TARGET("sse2") static const ushort* _findNewlineSse2( const ushort* p, const ushort* end )
+{
+	const __m128i nl = _mm_set1_epi16( '\n' );
+	while( end - p >= 8 )
+	{
+		const __m128i x = _mm_loadu_si128( reinterpret_cast<const __m128i*>( p ) );
+		const quint32 mask = _mm_movemask_epi8( _mm_cmpeq_epi16( x, nl ) );
+		if( mask != 0 )
+			return p + ( _firstBit( mask ) >> 1 );
+		p += 8;
+	}
+	return _findNewlineScalar( p, end );
+}
+
+ADA_SCAN_TARGET("sse2") static const ushort* _findStringStopSse2( const ushort* p, const ushort* end )
+{
+	const __m128i quote = _mm_set1_epi16( '"' );
+	const __m128i low = _mm_set1_epi16( 0x20 );
+	const __m128i range = _mm_set1_epi16( 0x7e - 0x20 );
+	const __m128i zero = _mm_setzero_si128();
+	while( end - p >= 8 )
+	{
+		const __m128i x = _mm_loadu_si128( reinterpret_cast<const __m128i*>( p ) );
+		// printable: x - 0x20 <= 0x5e unsigned
+		const __m128i print = _mm_cmpeq_epi16( _mm_subs_epu16( _mm_sub_epi16( x, low ), range ), zero );
+		const __m128i ok = _mm_andnot_si128( _mm_cmpeq_epi16( x, quote ), print );
+		const quint32 mask = quint32( _mm_movemask_epi8( ok ) ) ^ 0xffffu;
+		if( mask != 0 )
+			return p + ( _firstBit( mask ) >> 1 );
+		p += 8;
+	}
+	return _findStringStopScalar( p, end );
+}
+
+ADA_SCAN_TARGET("avx2") static const ushort* _skipAsciiSpaceAvx2( const ushort* p, const ushort* end )
+{
+	const __m256i blank = _mm256_set1_epi16( ' ' );
+	const __m256i tab = _mm256_set1_epi16( 9 );
+	const __m256i four = _mm256_set1_epi16( 4 );
+	const __m256i zero = _mm256_setzero_si256();
+	while( end - p >= 16 )
+	{
+		const __m256i x = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( p ) );
+		const __m256i ws = _mm256_or_si256( _mm256_cmpeq_epi16( x, blank ),
+			_mm256_cmpeq_epi16( _mm256_subs_epu16( _mm256_sub_epi16( x, tab ), four ), zero ) );
+		const quint32 mask = ~quint32( _mm256_movemask_epi8( ws ) );
+		if( mask != 0 )
+			return p + ( _firstBit( mask ) >> 1 );
+		p += 16;
+	}
+	return _skipAsciiSpaceScalar( p, end );
+}
+
+ADA_SCAN_TARGET("avx2") static const ushort* _findNewlineAvx2( const ushort* p, const ushort* end )
+{
+	const __m256i nl = _mm256_set1_epi16( '\n' );
+	while( end - p >= 16 )
+	{
+		const __m256i x = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( p ) );
+		const quint32 mask = _mm256_movemask_epi8( _mm256_cmpeq_epi16( x, nl ) );
+		if( mask != 0 )
+			return p + ( _firstBit( mask ) >> 1 );
+		p += 16;
+	}
+	return _findNewlineScalar( p, end );
+}
+
+ADA_SCAN_TARGET("avx2") static const ushort* _findStringStopAvx2( const ushort* p, const ushort* end )
+{
+	const __m256i quote = _mm256_set1_epi16( '"' );
+	const __m256i low = _mm256_set1_epi16( 0x20 );
+	const __m256i range = _mm256_set1_epi16( 0x7e - 0x20 );
+	const __m256i zero = _mm256_setzero_si256();
+	while( end - p >= 16 )
+	{
+		const __m256i x = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( p ) );
+		const __m256i print = _mm256_cmpeq_epi16( _mm256_subs_epu16( _mm256_sub_epi16( x, low ), range ), zero );
+		const __m256i ok = _mm256_andnot_si256( _mm256_cmpeq_epi16( x, quote ), print );
+		const quint32 mask = ~quint32( _mm256_movemask_epi8( ok ) );
+		if( mask != 0 )
+			return p + ( _firstBit( mask ) >> 1 );
+		p += 16;
+	}
+	return _findStringStopScalar( p, end );
+}
+
+static bool _hasAvx2()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid( info, 0 );
+	if( info[0] < 7 )
+		return false;
+	__cpuid( info, 1 );
+	const bool osxsave = ( info[2] & ( 1 << 27 ) ) != 0;
+	const bool avx = ( info[2] & ( 1 << 28 ) ) != 0;
+	if( !osxsave || !avx || ( _xgetbv( 0 ) & 6 ) != 6 )
+		return false; // the OS does not save the YMM registers
+	__cpuidex( info, 7, 0 );
+	return ( info[1] & ( 1 << 5 ) ) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports( "avx2" );
+#endif
+}
+
+static bool _hasSse2()
+{
+#ifdef _MSC_VER
+	return true; // always available on x64
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports( "sse2" );
+#endif
+}
+
+#endif // ADA_SCAN_X86
+
+static _Kernels _selectKernels()
+{
+	// ADA_SCAN_KERNEL=scalar|sse2 restricts the selection, e.g. to compare the results of the kernels
+	const char* force = ::getenv( "ADA_SCAN_KERNEL" );
+	const bool scalarOnly = force != 0 && ::strcmp( force, "scalar" ) == 0;
+	const bool noAvx2 = scalarOnly || ( force != 0 && ::strcmp( force, "sse2" ) == 0 );
+#ifdef ADA_SCAN_X86
+	if( !noAvx2 && _hasAvx2() )
+	{
+		const _Kernels k = { _skipAsciiSpaceAvx2, _findNewlineAvx2, _findStringStopAvx2, "AVX2" };
+		return k;
+	}
+	if( !scalarOnly && _hasSse2() )
+	{
+		const _Kernels k = { _skipAsciiSpaceSse2, _findNewlineSse2, _findStringStopSse2, "SSE2" };
+		return k;
+	}
+#else
+	Q_UNUSED( noAvx2 );
+#endif
+	const _Kernels k = { _skipAsciiSpaceScalar, _findNewlineScalar, _findStringStopScalar, "scalar" };
+	return k;
+}
+
+static const _Kernels& _kernels()
+{
+	// selected on first use, so it does not depend on the order of the static initialization of the
+	// translation units; the initialization of a local static is thread-safe
+	static const _Kernels s_kernels = _selectKernels();
+	return s_kernels;
+}
+
+const ushort* ScanKernels::skipAsciiSpace(const ushort* begin, const ushort* end)
+{
+	return _kernels().skipAsciiSpace( begin, end );
+}
+
+const ushort* ScanKernels::findNewline(const ushort* begin, const ushort* end)
+{
+	return _kernels().findNewline( begin, end );
+}
+
+const ushort* ScanKernels::findStringStop(const ushort* begin, const ushort* end)
+{
+	return _kernels().findStringStop( begin, end );
+}
+
+const char* ScanKernels::getKernelName()
+{
+	return _kernels().name;
+}
@@ -0,0 +1,43 @@
+#ifndef ADASCANKERNELS_H
+#define ADASCANKERNELS_H
+
+/*
+* Copyright 2012-2017 Rochus Keller <mailto:me@rochus-keller.info>
+*
+* This file is part of the AdaViewer application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.info.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <QtGlobal>
+
+namespace Ada
+{
+	// Kernels used by the Lexer to skip runs of characters. SSE2 or AVX2 versions are selected on
+	// first use depending on the CPU, with plain C++ as the fallback; all return the first character in
+	// [begin, end) which does not belong to the run, or end.
+	class ScanKernels
+	{
+	public:
+		// skips 0x09..0x0d and ' '; other Unicode spaces have to be checked by the caller
+		static const ushort* skipAsciiSpace( const ushort* begin, const ushort* end );
+		// finds '\n'
+		static const ushort* findNewline( const ushort* begin, const ushort* end );
+		// finds '"' or any character outside the printable ASCII range 0x20..0x7e
+		static const ushort* findStringStop( const ushort* begin, const ushort* end );
+		static const char* getKernelName(); // "AVX2", "SSE2" or "scalar"
+	};
+}
+
+#endif // ADASCANKERNELS_H
@@ -0,0 +1,213 @@
+/*
+* Copyright 2012-2017 Rochus Keller <mailto:me@rochus-keller.info>
+*
+* This file is part of the AdaViewer application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.info.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "AdaTokenCache.h"
+#include "AdaTokenStore.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDateTime>
+#include <QTemporaryFile>
+#include <QCryptographicHash>
+#include <string.h>
+#ifdef Q_OS_WIN
+#include <sys/utime.h>
+#else
+#include <utime.h>
+#include <unistd.h>
+#endif
+using namespace Ada;
+
+static const quint32 s_magic = 0x31435441; // "ATC1"; also detects files of the other byte order
+static const quint32 s_version = 1;
+static const int s_hashLen = 20; // SHA-1
+static const int s_tmpAge = 3600; // seconds; older temporary files were left by a crash
+
+// The file is the header, the UTF-8 path and the arrays of the TokenStore, each padded to 4 bytes
+struct _Header
+{
+	quint32 d_magic;
+	quint32 d_version;
+	qint64 d_size;
+	qint64 d_mtime;
+	quint8 d_hash[s_hashLen];
+	quint32 d_pathLen;
+	quint32 d_count;
+	quint32 d_lineCount;
+};
+
+static inline qint64 _align( qint64 len )
+{
+	return ( len + 3 ) & ~qint64(3);
+}
+
+static qint64 _fileSize( const _Header& h )
+{
+	return sizeof(_Header) + _align( h.d_pathLen ) + _align( h.d_count ) +
+			2 * 4 * qint64( h.d_count ) + 2 * 4 * qint64( h.d_lineCount );
+}
+
+static bool _write( QIODevice& out, const void* data, qint64 len )
+{
+	if( out.write( static_cast<const char*>( data ), len ) != len )
+		return false;
+	static const char s_zeros[4] = { 0, 0, 0, 0 };
+	const qint64 pad = _align( len ) - len;
+	return out.write( s_zeros, pad ) == pad;
+}
+
+TokenCache::Key::Key(const QString& path, const QByteArray& contents)
+{
+	const QFileInfo info( path );
+	d_path = info.canonicalFilePath(); // empty if the file does not exist
+	d_size = info.size();
+	d_mtime = info.lastModified().toMSecsSinceEpoch();
+	d_hash = QCryptographicHash::hash( contents, QCryptographicHash::Sha1 );
+}
+
+TokenCache::TokenCache(const QString& dir, qint64 maxSize):d_dir(dir),d_maxSize(maxSize)
+{
+}
+
+QString TokenCache::cacheFile(const Key& key) const
+{
+	return d_dir + QLatin1Char('/') +
+			QString::fromLatin1( QCryptographicHash::hash( key.d_path.toUtf8(), QCryptographicHash::Sha1 ).toHex() ) +
+			QLatin1String(".tok");
+}
+
+bool TokenCache::load(const Key& key, TokenStore& out) const
+{
+	if( !key.isValid() )
+		return false;
+	QFile f( cacheFile( key ) );
+	if( !f.open( QIODevice::ReadOnly ) )
+		return false;
+	const qint64 len = f.size();
+	uchar* p = ( len >= qint64( sizeof(_Header) ) ) ? f.map( 0, len ) : 0;
+	bool ok = false;
+	if( p != 0 )
+	{
+		_Header h;
+		::memcpy( &h, p, sizeof(h) );
+		const QByteArray path = key.d_path.toUtf8();
+		// a file of an older version of the source, or a damaged one, is removed
+		ok = h.d_magic == s_magic && h.d_version == s_version && _fileSize( h ) == len &&
+				h.d_size == key.d_size && h.d_mtime == key.d_mtime &&
+				key.d_hash.size() == s_hashLen && ::memcmp( h.d_hash, key.d_hash.constData(), s_hashLen ) == 0 &&
+				h.d_pathLen == quint32( path.size() ) && ::memcmp( p + sizeof(h), path.constData(), path.size() ) == 0;
+		if( ok )
+		{
+			const uchar* q = p + sizeof(h) + _align( h.d_pathLen );
+			out.clear();
+			out.reserve( h.d_count );
+			::memcpy( out.d_types.data(), q, h.d_count );
+			q += _align( h.d_count );
+			::memcpy( out.d_offs.data(), q, 4 * h.d_count );
+			q += 4 * h.d_count;
+			::memcpy( out.d_lens.data(), q, 4 * h.d_count );
+			q += 4 * h.d_count;
+			out.d_count = h.d_count;
+			if( out.d_lineNrs.size() < int( h.d_lineCount ) )
+			{
+				out.d_lineNrs.resize( h.d_lineCount );
+				out.d_lineStarts.resize( h.d_lineCount );
+			}
+			::memcpy( out.d_lineNrs.data(), q, 4 * h.d_lineCount );
+			q += 4 * h.d_lineCount;
+			::memcpy( out.d_lineStarts.data(), q, 4 * h.d_lineCount );
+			out.d_lineCount = h.d_lineCount;
+		}
+		f.unmap( p );
+	}
+	f.close();
+	if( !ok )
+	{
+		QFile::remove( f.fileName() );
+		return false;
+	}
+	// the modification time of the file is its last use for the LRU order
+	::utime( QFile::encodeName( f.fileName() ).constData(), 0 );
+	return true;
+}
+
+bool TokenCache::store(const Key& key, const TokenStore& tokens) const
+{
+	if( !key.isValid() || key.d_hash.size() != s_hashLen || !QDir().mkpath( d_dir ) )
+		return false;
+	_Header h;
+	::memset( &h, 0, sizeof(h) );
+	h.d_magic = s_magic;
+	h.d_version = s_version;
+	h.d_size = key.d_size;
+	h.d_mtime = key.d_mtime;
+	::memcpy( h.d_hash, key.d_hash.constData(), s_hashLen );
+	const QByteArray path = key.d_path.toUtf8();
+	h.d_pathLen = path.size();
+	h.d_count = tokens.d_count;
+	h.d_lineCount = tokens.d_lineCount;
+
+	// readers never see an incomplete file, since it only gets its name when written
+	QTemporaryFile tmp( d_dir + QLatin1String("/XXXXXX.tmp") );
+	if( !tmp.open() )
+		return false;
+	bool ok = _write( tmp, &h, sizeof(h) ) && _write( tmp, path.constData(), path.size() ) &&
+			_write( tmp, tokens.d_types.constData(), h.d_count ) &&
+			_write( tmp, tokens.d_offs.constData(), 4 * h.d_count ) &&
+			_write( tmp, tokens.d_lens.constData(), 4 * h.d_count ) &&
+			_write( tmp, tokens.d_lineNrs.constData(), 4 * h.d_lineCount ) &&
+			_write( tmp, tokens.d_lineStarts.constData(), 4 * h.d_lineCount ) &&
+			tmp.flush();
+#ifndef Q_OS_WIN
+	ok = ok && ::fsync( tmp.handle() ) == 0; // the contents are on disk before the name is
+#endif
+	if( !ok )
+		return false;
+	const QString name = cacheFile( key );
+	QFile::remove( name );
+	tmp.setAutoRemove( false ); // else the renamed file would be removed
+	if( !tmp.rename( name ) )
+	{
+		tmp.remove();
+		return false;
+	}
+	evict();
+	return true;
+}
+
+void TokenCache::evict() const
+{
+	const QDir dir( d_dir );
+	const QDateTime old = QDateTime::currentDateTime().addSecs( -s_tmpAge );
+	const QFileInfoList tmps = dir.entryInfoList( QStringList() << QLatin1String("*.tmp"), QDir::Files );
+	for( int i = 0; i < tmps.size(); i++ )
+	{
+		if( tmps[i].lastModified() < old )
+			QFile::remove( tmps[i].absoluteFilePath() );
+	}
+	// most recently used first
+	const QFileInfoList files = dir.entryInfoList( QStringList() << QLatin1String("*.tok"), QDir::Files, QDir::Time );
+	qint64 total = 0;
+	for( int i = 0; i < files.size(); i++ )
+	{
+		total += files[i].size();
+		if( total > d_maxSize )
+			QFile::remove( files[i].absoluteFilePath() );
+	}
+}
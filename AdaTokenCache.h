@@ -0,0 +1,62 @@
+#ifndef ADATOKENCACHE_H
+#define ADATOKENCACHE_H
+
+/*
+* Copyright 2012-2017 Rochus Keller <mailto:me@rochus-keller.info>
+*
+* This file is part of the AdaViewer application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.info.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <QString>
+#include <QByteArray>
+
+namespace Ada
+{
+	class TokenStore;
+
+	// Directory with the tokens of source files, so unchanged files need not be lexed again. There is
+	// one file per source path; it is only used if size, modification time and content hash of the
+	// source still agree. Files are written under a temporary name and renamed when complete; the
+	// least recently used ones are deleted when the directory grows beyond its maximum size.
+	// All methods are reentrant, store() is called from worker threads.
+	class TokenCache
+	{
+	public:
+		struct Key
+		{
+			QString d_path; // canonical
+			qint64 d_size;
+			qint64 d_mtime; // ms since epoch
+			QByteArray d_hash; // SHA-1 of the contents
+			Key():d_size(0),d_mtime(0) {}
+			Key( const QString& path, const QByteArray& contents );
+			bool isValid() const { return !d_path.isEmpty(); }
+		};
+
+		explicit TokenCache( const QString& dir, qint64 maxSize = 256 * 1024 * 1024 );
+		const QString& getDir() const { return d_dir; }
+		bool load( const Key&, TokenStore& ) const; // the file is memory-mapped and copied to the store
+		bool store( const Key&, const TokenStore& ) const;
+		void evict() const;
+	protected:
+		QString cacheFile( const Key& ) const;
+	private:
+		QString d_dir;
+		qint64 d_maxSize; // bytes
+	};
+}
+
+#endif // ADATOKENCACHE_H
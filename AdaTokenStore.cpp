@@ -0,0 +1,210 @@
+/*
+* Copyright 2012-2017 Rochus Keller <mailto:me@rochus-keller.info>
+*
+* This file is part of the AdaViewer application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.info.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "AdaTokenStore.h"
+#include <QtAlgorithms>
+#include <string.h>
+using namespace Ada;
+
+TokenStore::TokenStore():d_count(0),d_lineCount(0)
+{
+}
+
+void TokenStore::clear()
+{
+	d_count = 0;
+	d_lineCount = 0;
+}
+
+void TokenStore::reserve(int size)
+{
+	if( size <= d_types.size() )
+		return;
+	d_types.resize( size );
+	d_offs.resize( size );
+	d_lens.resize( size );
+}
+
+void TokenStore::append(const LexerCore::Token & t)
+{
+	if( d_count == d_types.size() )
+		reserve( qMax( 256, d_count * 2 ) );
+	d_types[d_count] = t.d_type;
+	d_offs[d_count] = t.d_off;
+	d_lens[d_count] = t.d_len;
+	d_count++;
+	if( d_lineCount == 0 || d_lineNrs[d_lineCount - 1] != t.d_line )
+	{
+		if( d_lineCount == d_lineNrs.size() )
+		{
+			const int size = qMax( 64, d_lineCount * 2 );
+			d_lineNrs.resize( size );
+			d_lineStarts.resize( size );
+		}
+		d_lineNrs[d_lineCount] = t.d_line;
+		d_lineStarts[d_lineCount] = t.d_off - t.d_col;
+		d_lineCount++;
+	}
+}
+
+void TokenStore::append(const TokenStore& from, int begin, qint32 offDelta, qint32 lineDelta)
+{
+	const int n = from.d_count - begin;
+	if( n <= 0 )
+		return;
+	if( d_count + n > d_types.size() )
+		reserve( qMax( d_count + n, d_count * 2 ) );
+	::memcpy( d_types.data() + d_count, from.d_types.constData() + begin, n * sizeof(quint8) );
+	::memcpy( d_offs.data() + d_count, from.d_offs.constData() + begin, n * sizeof(quint32) );
+	::memcpy( d_lens.data() + d_count, from.d_lens.constData() + begin, n * sizeof(quint32) );
+	for( int i = d_count; i < d_count + n; i++ )
+		d_offs[i] += offDelta;
+	d_count += n;
+
+	// the line of the first token is only entered if it is not already the last one
+	int l = qMax( from.findLine( from.d_offs[begin] ), 0 );
+	if( d_lineCount > 0 && d_lineNrs[d_lineCount - 1] == from.d_lineNrs[l] + lineDelta )
+		l++;
+	const int lines = from.d_lineCount - l;
+	if( d_lineCount + lines > d_lineNrs.size() )
+	{
+		const int size = qMax( d_lineCount + lines, d_lineCount * 2 );
+		d_lineNrs.resize( size );
+		d_lineStarts.resize( size );
+	}
+	::memcpy( d_lineNrs.data() + d_lineCount, from.d_lineNrs.constData() + l, lines * sizeof(quint32) );
+	::memcpy( d_lineStarts.data() + d_lineCount, from.d_lineStarts.constData() + l, lines * sizeof(quint32) );
+	for( int i = d_lineCount; i < d_lineCount + lines; i++ )
+	{
+		d_lineNrs[i] += lineDelta;
+		d_lineStarts[i] += offDelta;
+	}
+	d_lineCount += lines;
+}
+
+template<class T>
+static void _splice( QVector<T>& v, int size, int at, int removed, const T* with, int inserted )
+{
+	// v has room for size - removed + inserted elements
+	T* d = v.data();
+	::memmove( d + at + inserted, d + at + removed, ( size - at - removed ) * sizeof(T) );
+	::memcpy( d + at, with, inserted * sizeof(T) );
+}
+
+void TokenStore::replace(int first, int count, const TokenStore& with, qint32 offDelta, qint32 lineDelta)
+{
+	const int tail = first + count;
+
+	// line entries of the lines before and after the replaced tokens are kept, unless with has
+	// tokens on the same line
+	const int headLines = ( first > 0 ) ? findLine( d_offs[first - 1] ) + 1 : 0;
+	int tailLines = ( tail < d_count ) ? qMax( findLine( d_offs[tail] ), headLines ) : d_lineCount;
+	int withFrom = 0;
+	if( headLines > 0 && with.d_lineCount > 0 && with.d_lineNrs[0] == d_lineNrs[headLines - 1] )
+		withFrom = 1;
+	if( tailLines < d_lineCount )
+	{
+		if( with.d_lineCount > withFrom )
+		{
+			if( d_lineNrs[tailLines] + lineDelta == with.d_lineNrs[with.d_lineCount - 1] )
+				tailLines++;
+		}else if( headLines > 0 && d_lineNrs[tailLines] + lineDelta == d_lineNrs[headLines - 1] )
+			tailLines++;
+	}
+
+	const int newCount = d_count - count + with.d_count;
+	reserve( newCount );
+	_splice( d_types, d_count, first, count, with.d_types.constData(), with.d_count );
+	_splice( d_offs, d_count, first, count, with.d_offs.constData(), with.d_count );
+	_splice( d_lens, d_count, first, count, with.d_lens.constData(), with.d_count );
+	for( int i = first + with.d_count; i < newCount; i++ )
+		d_offs[i] += offDelta;
+	d_count = newCount;
+
+	const int removedLines = tailLines - headLines;
+	const int insertedLines = with.d_lineCount - withFrom;
+	const int newLineCount = d_lineCount - removedLines + insertedLines;
+	if( newLineCount > d_lineNrs.size() )
+	{
+		d_lineNrs.resize( newLineCount );
+		d_lineStarts.resize( newLineCount );
+	}
+	_splice( d_lineNrs, d_lineCount, headLines, removedLines, with.d_lineNrs.constData() + withFrom, insertedLines );
+	_splice( d_lineStarts, d_lineCount, headLines, removedLines, with.d_lineStarts.constData() + withFrom, insertedLines );
+	for( int i = headLines + insertedLines; i < newLineCount; i++ )
+	{
+		d_lineNrs[i] += lineDelta;
+		d_lineStarts[i] += offDelta;
+	}
+	d_lineCount = newLineCount;
+}
+
+quint32 TokenStore::getLine(int i) const
+{
+	const int l = findLine( d_offs[i] );
+	if( l < 0 )
+		return 0;
+	else
+		return d_lineNrs[l];
+}
+
+quint32 TokenStore::getCol(int i) const
+{
+	const int l = findLine( d_offs[i] );
+	if( l < 0 )
+		return d_offs[i];
+	else
+		return d_offs[i] - d_lineStarts[l];
+}
+
+LexerCore::Token TokenStore::getToken(int i, const QChar* source) const
+{
+	// the error text of T_Invalid is not stored
+	const quint32 off = d_offs[i];
+	const int l = findLine( off );
+	return LexerCore::Token( LexerCore::TokenType( d_types[i] ), ( l < 0 ) ? 0 : d_lineNrs[l],
+						 ( l < 0 ) ? off : off - d_lineStarts[l], d_lens[i], off,
+						 ( source != 0 ) ? source + off : 0 );
+}
+
+int TokenStore::findToken(quint32 off) const
+{
+	const quint32* begin = d_offs.constData();
+	const int i = qUpperBound( begin, begin + d_count, off ) - begin - 1;
+	if( i >= 0 && off < d_offs[i] + d_lens[i] )
+		return i;
+	else
+		return -1;
+}
+
+int TokenStore::lowerBound(quint32 off) const
+{
+	const quint32* begin = d_offs.constData();
+	const int i = qUpperBound( begin, begin + d_count, off ) - begin - 1;
+	if( i >= 0 && off < d_offs[i] + d_lens[i] )
+		return i;
+	else
+		return i + 1;
+}
+
+int TokenStore::findLine(quint32 off) const
+{
+	const quint32* begin = d_lineStarts.constData();
+	return qUpperBound( begin, begin + d_lineCount, off ) - begin - 1;
+}
@@ -0,0 +1,66 @@
+#ifndef ADATOKENSTORE_H
+#define ADATOKENSTORE_H
+
+/*
+* Copyright 2012-2017 Rochus Keller <mailto:me@rochus-keller.info>
+*
+* This file is part of the AdaViewer application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.info.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "AdaLexer.h"
+#include <QVector>
+
+namespace Ada
+{
+	// Compact token list; types, offsets and lengths are kept in separate arrays (9 bytes per token),
+	// line numbers are only stored once per line with tokens.
+	class TokenStore
+	{
+	public:
+		TokenStore();
+		void clear(); // keeps the allocated memory for reuse
+		void reserve( int );
+		void append( const LexerCore::Token& );
+		// appends the tokens of from starting at begin; their offsets and line numbers are moved by the deltas
+		void append( const TokenStore& from, int begin, qint32 offDelta, qint32 lineDelta );
+		// replaces count tokens at first by the ones of with, which are in the same coordinates as the
+		// tokens following them, i.e. the offsets and line numbers of these are moved by the deltas
+		void replace( int first, int count, const TokenStore& with, qint32 offDelta, qint32 lineDelta );
+		int getCount() const { return d_count; }
+		bool isEmpty() const { return d_count == 0; }
+		quint8 getType( int i ) const { return d_types[i]; }
+		quint32 getOffset( int i ) const { return d_offs[i]; }
+		quint32 getLength( int i ) const { return d_lens[i]; }
+		quint32 getLine( int i ) const; // starting with 1
+		quint32 getCol( int i ) const;  // starting with 0
+		LexerCore::Token getToken( int i, const QChar* source = 0 ) const;
+		int findToken( quint32 off ) const; // index of the token covering off or -1
+		int lowerBound( quint32 off ) const; // index of the first token ending after off
+	protected:
+		int findLine( quint32 off ) const;
+	private:
+		friend class TokenCache; // writes and maps the arrays
+		QVector<quint8> d_types;
+		QVector<quint32> d_offs;
+		QVector<quint32> d_lens;
+		QVector<quint32> d_lineNrs;    // numbers of the lines which have tokens
+		QVector<quint32> d_lineStarts; // offset of these lines
+		int d_count;
+		int d_lineCount;
+	};
+}
+
+#endif // ADATOKENSTORE_H
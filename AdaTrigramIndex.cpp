@@ -0,0 +1,639 @@
+/*
+* Copyright 2012-2017 Rochus Keller <mailto:me@rochus-keller.info>
+*
+* This file is part of the AdaViewer application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.info.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "AdaTrigramIndex.h"
+#include "AdaLexer.h"
+#include "AdaByteLexer.h"
+#include "AdaFindEngine.h"
+#include <QFileInfo>
+#include <QDir>
+#include <QDirIterator>
+#include <QDateTime>
+#include <QHash>
+#include <QPair>
+#include <QTemporaryFile>
+#include <QCryptographicHash>
+#include <QtConcurrentMap>
+#include <QtAlgorithms>
+#include <string.h>
+#ifndef Q_OS_WIN
+#include <unistd.h>
+#endif
+using namespace Ada;
+
+static const quint32 s_magic = 0x31495441; // "ATI1"; also detects files of the other byte order
+static const quint32 s_version = 1;
+static const int s_batch = 256; // files lexed in parallel at a time
+
+// The file is the header, the table of the files sorted by name, the UTF-8 root and names, the
+// posting lists and the table of the trigrams sorted by value, each aligned to 8 bytes. A posting
+// list holds the ascending ids of the files, each as the difference to the one before in groups of
+// 7 bits, the low group first.
+struct _IndexHeader
+{
+	quint32 d_magic;
+	quint32 d_version;
+	quint32 d_fileCount;
+	quint32 d_trigramCount;
+	quint32 d_rootLen;
+	quint32 d_reserved;
+	qint64 d_namesOff;
+	qint64 d_postOff;
+	qint64 d_tableOff;
+	qint64 d_size;
+};
+
+struct _File
+{
+	qint64 d_size;
+	qint64 d_mtime;    // ms since epoch
+	quint32 d_nameOff; // relative to d_namesOff
+	quint32 d_nameLen;
+};
+
+struct _Trigram
+{
+	quint32 d_trigram;
+	quint32 d_count; // of files
+	qint64 d_off;    // of the posting list, relative to d_postOff
+};
+
+// a file of the tree when updating
+struct _Entry
+{
+	QString d_name; // relative to the root
+	qint64 d_size;
+	qint64 d_mtime;
+};
+
+// of the files lexed by update()
+struct _Postings
+{
+	quint32 d_last;
+	quint32 d_count;
+	QByteArray d_list;
+	_Postings():d_last(0),d_count(0) {}
+};
+
+static inline qint64 _align( qint64 len )
+{
+	return ( len + 7 ) & ~qint64(7);
+}
+
+static bool _pad( QIODevice& out, qint64 len )
+{
+	static const char s_zeros[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+	const qint64 pad = _align( len ) - len;
+	return out.write( s_zeros, pad ) == pad;
+}
+
+static bool _write( QIODevice& out, const void* data, qint64 len )
+{
+	return out.write( static_cast<const char*>( data ), len ) == len && _pad( out, len );
+}
+
+static inline const _IndexHeader* _header( const uchar* map )
+{
+	return reinterpret_cast<const _IndexHeader*>( map );
+}
+
+static inline const _File* _files( const uchar* map )
+{
+	return reinterpret_cast<const _File*>( map + sizeof(_IndexHeader) );
+}
+
+static inline const _Trigram* _table( const uchar* map )
+{
+	return reinterpret_cast<const _Trigram*>( map + _header( map )->d_tableOff );
+}
+
+static inline bool _lessName( const _Entry& lhs, const _Entry& rhs )
+{
+	return lhs.d_name < rhs.d_name;
+}
+
+static inline bool _lessTrigram( const _Trigram& lhs, const _Trigram& rhs )
+{
+	return lhs.d_trigram < rhs.d_trigram;
+}
+
+static inline bool _cancelled( const QAtomicInt* cancel )
+{
+	return cancel != 0 && int( *cancel ) != 0;
+}
+
+template<class C>
+static inline quint32 _trigram( const C* p )
+{
+	// characters beyond Latin-1 share the value with one of it; the search of the candidates sorts them out
+	return ( quint32( FindEngine::fold( QChar( p[0] ).unicode() ) & 0xff ) << 16 ) |
+			( quint32( FindEngine::fold( QChar( p[1] ).unicode() ) & 0xff ) << 8 ) |
+			quint32( FindEngine::fold( QChar( p[2] ).unicode() ) & 0xff );
+}
+
+static inline void _putVarint( QByteArray& out, quint32 v )
+{
+	while( v >= 0x80 )
+	{
+		out.append( char( ( v & 0x7f ) | 0x80 ) );
+		v >>= 7;
+	}
+	out.append( char( v ) );
+}
+
+static void _decode( const uchar* p, quint32 count, QVector<quint32>& out )
+{
+	out.resize( count );
+	quint32 id = 0;
+	for( quint32 i = 0; i < count; i++ )
+	{
+		quint32 delta = 0;
+		int shift = 0;
+		while( *p & 0x80 )
+		{
+			delta |= quint32( *p++ & 0x7f ) << shift;
+			shift += 7;
+		}
+		delta |= quint32( *p++ ) << shift;
+		id += delta;
+		out[i] = id;
+	}
+}
+
+static void _encode( const QVector<quint32>& ids, QByteArray& out )
+{
+	out.clear();
+	quint32 last = 0;
+	for( int i = 0; i < ids.size(); i++ )
+	{
+		_putVarint( out, ids[i] - last );
+		last = ids[i];
+	}
+}
+
+static void _sortUnique( QVector<quint32>& v )
+{
+	qSort( v );
+	int n = 0;
+	for( int i = 0; i < v.size(); i++ )
+	{
+		if( n == 0 || v[n - 1] != v[i] )
+			v[n++] = v[i];
+	}
+	v.resize( n );
+}
+
+static void _merge( const QVector<quint32>& a, const QVector<quint32>& b, QVector<quint32>& out )
+{
+	out.resize( a.size() + b.size() );
+	int i = 0, j = 0, n = 0;
+	while( i < a.size() && j < b.size() )
+		out[n++] = ( a[i] < b[j] ) ? a[i++] : b[j++];
+	while( i < a.size() )
+		out[n++] = a[i++];
+	while( j < b.size() )
+		out[n++] = b[j++];
+}
+
+static void _intersect( const QVector<quint32>& a, const QVector<quint32>& b, QVector<quint32>& out )
+{
+	out.clear();
+	int i = 0, j = 0;
+	while( i < a.size() && j < b.size() )
+	{
+		if( a[i] < b[j] )
+			i++;
+		else if( b[j] < a[i] )
+			j++;
+		else
+		{
+			out.append( a[i] );
+			i++;
+			j++;
+		}
+	}
+}
+
+static bool _hasSpace( const uchar* from, const uchar* to )
+{
+	for( const uchar* p = from; p < to; p++ )
+	{
+		if( QChar( *p ).isSpace() )
+			return true;
+	}
+	return false;
+}
+
+static void _addTrigrams( const uchar* p, int len, QVector<quint32>& out )
+{
+	for( int i = 0; i + 3 <= len; i++ )
+		out.append( _trigram( p + i ) );
+}
+
+static QVector<quint32> _fileTrigrams( const QString& path )
+{
+	QVector<quint32> res;
+	QFile f( path );
+	if( f.open( QIODevice::ReadOnly ) )
+		TrigramIndex::extract( f.readAll(), res ); // Latin-1 like Editor::loadFromFile()
+	return res;
+}
+
+TrigramIndex::TrigramIndex(const QString& root, const QString& dir):d_dir(dir),d_map(0),d_size(0)
+{
+	d_root = QFileInfo( root ).canonicalFilePath(); // empty if the directory does not exist
+}
+
+TrigramIndex::~TrigramIndex()
+{
+	close();
+}
+
+QString TrigramIndex::getIndexFile() const
+{
+	return d_dir + QLatin1Char('/') +
+			QString::fromLatin1( QCryptographicHash::hash( d_root.toUtf8(), QCryptographicHash::Sha1 ).toHex() ) +
+			QLatin1String(".tri");
+}
+
+bool TrigramIndex::open()
+{
+	close();
+	if( d_root.isEmpty() )
+		return false;
+	d_file.setFileName( getIndexFile() );
+	if( !d_file.open( QIODevice::ReadOnly ) )
+		return false;
+	d_size = d_file.size();
+	uchar* p = ( d_size >= qint64( sizeof(_IndexHeader) ) ) ? d_file.map( 0, d_size ) : 0;
+	if( p != 0 )
+	{
+		const _IndexHeader* h = _header( p );
+		const QByteArray root = d_root.toUtf8();
+		// an index of an older version, or a damaged one, is not used and replaced by update()
+		if( h->d_magic == s_magic && h->d_version == s_version && h->d_size == d_size &&
+				h->d_namesOff == qint64( sizeof(_IndexHeader) ) + _align( sizeof(_File) * qint64( h->d_fileCount ) ) &&
+				h->d_namesOff <= h->d_postOff && h->d_postOff <= h->d_tableOff &&
+				h->d_tableOff + qint64( sizeof(_Trigram) ) * h->d_trigramCount == d_size &&
+				h->d_rootLen == quint32( root.size() ) && h->d_namesOff + h->d_rootLen <= h->d_postOff &&
+				::memcmp( p + h->d_namesOff, root.constData(), root.size() ) == 0 )
+		{
+			d_map = p;
+			return true;
+		}
+		d_file.unmap( p );
+	}
+	d_file.close();
+	return false;
+}
+
+void TrigramIndex::close()
+{
+	if( d_map != 0 )
+		d_file.unmap( d_map );
+	d_map = 0;
+	d_size = 0;
+	d_file.close();
+}
+
+int TrigramIndex::getFileCount() const
+{
+	return ( d_map != 0 ) ? _header( d_map )->d_fileCount : 0;
+}
+
+QString TrigramIndex::getName(int file) const
+{
+	const _File& f = _files( d_map )[file];
+	return QString::fromUtf8( reinterpret_cast<const char*>( d_map + _header( d_map )->d_namesOff + f.d_nameOff ),
+							  f.d_nameLen );
+}
+
+QString TrigramIndex::getPath(int file) const
+{
+	return d_root + QLatin1Char('/') + getName( file );
+}
+
+void TrigramIndex::extract(const QByteArray& latin1, QVector<quint32>& out)
+{
+	// Tokens with nothing or no whitespace between them form a span; the trigrams are those within
+	// the spans, so the indentation and the blanks around operators are left out.
+	out.clear();
+	const uchar* str = reinterpret_cast<const uchar*>( latin1.constData() );
+	ByteLexer lex;
+	lex.setBuffer( latin1, ByteLexer::Latin1 );
+	int start = -1;
+	int end = -1;
+	forever
+	{
+		const ByteLexer::Token t = lex.nextToken();
+		if( !t.isEof() && start != -1 && !_hasSpace( str + end, str + t.d_byteOff ) )
+			end = t.d_byteOff + t.d_byteLen;
+		else
+		{
+			if( start != -1 )
+				_addTrigrams( str + start, end - start, out );
+			if( t.isEof() )
+				break;
+			start = t.d_byteOff;
+			end = t.d_byteOff + t.d_byteLen;
+		}
+	}
+	_sortUnique( out );
+}
+
+bool TrigramIndex::postings(quint32 trigram, const uchar*& p, quint32& count) const
+{
+	const _IndexHeader* h = _header( d_map );
+	const _Trigram* begin = _table( d_map );
+	const _Trigram* end = begin + h->d_trigramCount;
+	_Trigram key;
+	key.d_trigram = trigram;
+	const _Trigram* e = qLowerBound( begin, end, key, _lessTrigram );
+	if( e == end || e->d_trigram != trigram )
+		return false;
+	p = d_map + h->d_postOff + e->d_off;
+	count = e->d_count;
+	return true;
+}
+
+QVector<quint32> TrigramIndex::candidates(const QString& query) const
+{
+	QVector<quint32> res;
+	if( d_map == 0 || query.isEmpty() )
+		return res;
+	// whitespace is only indexed within comments and literals
+	QVector<quint32> tris;
+	const QChar* q = query.constData();
+	for( int i = 0; i + 3 <= query.size(); i++ )
+	{
+		if( !q[i].isSpace() && !q[i + 1].isSpace() && !q[i + 2].isSpace() )
+			tris.append( _trigram( q + i ) );
+	}
+	_sortUnique( tris );
+	if( tris.isEmpty() )
+	{
+		// nothing to look up; every file has to be searched
+		res.resize( getFileCount() );
+		for( int i = 0; i < res.size(); i++ )
+			res[i] = i;
+		return res;
+	}
+	// the shortest posting list first, so the candidates only get fewer
+	QList< QPair<quint32,const uchar*> > lists;
+	for( int i = 0; i < tris.size(); i++ )
+	{
+		const uchar* p;
+		quint32 count;
+		if( !postings( tris[i], p, count ) )
+			return res;
+		lists.append( qMakePair( count, p ) );
+	}
+	qSort( lists );
+	_decode( lists[0].second, lists[0].first, res );
+	QVector<quint32> other;
+	QVector<quint32> both;
+	for( int i = 1; i < lists.size() && !res.isEmpty(); i++ )
+	{
+		_decode( lists[i].second, lists[i].first, other );
+		_intersect( res, other, both );
+		res = both;
+	}
+	return res;
+}
+
+TrigramIndex::Hits TrigramIndex::find(const QString& query, bool caseSensitive, int maxHits,
+									  const QAtomicInt* cancel) const
+{
+	Hits hits;
+	const QVector<quint32> files = candidates( query );
+	FindEngine finder;
+	finder.setPattern( query, caseSensitive );
+	for( int i = 0; i < files.size() && hits.size() < maxHits && !_cancelled( cancel ); i++ )
+	{
+		Hit hit;
+		hit.d_path = getPath( files[i] );
+		QFile f( hit.d_path );
+		if( !f.open( QIODevice::ReadOnly ) )
+			continue;
+		finder.setText( QString::fromLatin1( f.readAll() ) );
+		const QString& text = finder.getText();
+		int from = 0;
+		while( hits.size() < maxHits )
+		{
+			const int off = finder.find( from, false );
+			if( off == -1 )
+				break;
+			hit.d_line = finder.findBlock( off );
+			const int start = finder.getBlockStart( hit.d_line );
+			const int end = ( hit.d_line + 1 < finder.getBlockCount() ) ?
+						finder.getBlockStart( hit.d_line + 1 ) - 1 : text.size();
+			hit.d_col = off - start;
+			hit.d_text = text.mid( start, end - start );
+			hits.append( hit );
+			from = off + 1;
+		}
+	}
+	return hits;
+}
+
+bool TrigramIndex::update()
+{
+	const QString file = prepareUpdate();
+	if( file.isEmpty() )
+		return isOpen(); // up to date, or the old index is kept
+	return commitUpdate( file );
+}
+
+QString TrigramIndex::prepareUpdate(const QAtomicInt* cancel) const
+{
+	if( d_root.isEmpty() )
+		return QString();
+
+	// the files of the tree, sorted like the table of the index
+	QList<_Entry> files;
+	const QDir root( d_root );
+	QDirIterator it( d_root, QStringList() << QLatin1String("*.ads") << QLatin1String("*.adb"),
+					 QDir::Files, QDirIterator::Subdirectories );
+	while( it.hasNext() )
+	{
+		if( _cancelled( cancel ) )
+			return QString();
+		it.next();
+		const QFileInfo info = it.fileInfo();
+		_Entry e;
+		e.d_name = root.relativeFilePath( info.filePath() );
+		e.d_size = info.size();
+		e.d_mtime = info.lastModified().toMSecsSinceEpoch();
+		files.append( e );
+	}
+	qSort( files.begin(), files.end(), _lessName );
+
+	// the ids of the old index which are still valid, in the new numbering; the others are lexed
+	const int oldCount = getFileCount();
+	QHash<QString,int> old;
+	for( int i = 0; i < oldCount; i++ )
+		old.insert( getName( i ), i );
+	QVector<int> renumber( oldCount, -1 );
+	QStringList changed;
+	QVector<quint32> changedIds;
+	for( int i = 0; i < files.size(); i++ )
+	{
+		const int j = old.value( files[i].d_name, -1 );
+		if( j != -1 && _files( d_map )[j].d_size == files[i].d_size && _files( d_map )[j].d_mtime == files[i].d_mtime )
+			renumber[j] = i;
+		else
+		{
+			changed.append( root.absoluteFilePath( files[i].d_name ) );
+			changedIds.append( i );
+		}
+	}
+	if( d_map != 0 && changed.isEmpty() && files.size() == oldCount )
+		return QString();
+
+	// the lists of the lexed files are ascending, since they are added in the order of the ids
+	QHash<quint32,_Postings> added;
+	for( int from = 0; from < changed.size(); from += s_batch )
+	{
+		if( _cancelled( cancel ) )
+			return QString();
+		const QList< QVector<quint32> > res =
+				QtConcurrent::blockingMapped< QList< QVector<quint32> > >( changed.mid( from, s_batch ), _fileTrigrams );
+		for( int i = 0; i < res.size(); i++ )
+		{
+			const quint32 id = changedIds[from + i];
+			const QVector<quint32>& tris = res[i];
+			for( int k = 0; k < tris.size(); k++ )
+			{
+				_Postings& p = added[ tris[k] ];
+				_putVarint( p.d_list, id - p.d_last );
+				p.d_last = id;
+				p.d_count++;
+			}
+		}
+	}
+
+	if( !QDir().mkpath( d_dir ) )
+		return QString();
+	// readers never see an incomplete index, since it only gets its name when written
+	QTemporaryFile tmp( d_dir + QLatin1String("/XXXXXX.tmp") );
+	if( !tmp.open() )
+		return QString();
+	_IndexHeader h;
+	::memset( &h, 0, sizeof(h) );
+	h.d_magic = s_magic;
+	h.d_version = s_version;
+	h.d_fileCount = files.size();
+	QByteArray names = d_root.toUtf8();
+	h.d_rootLen = names.size();
+	QVector<_File> table( files.size() );
+	for( int i = 0; i < files.size(); i++ )
+	{
+		const QByteArray name = files[i].d_name.toUtf8();
+		table[i].d_size = files[i].d_size;
+		table[i].d_mtime = files[i].d_mtime;
+		table[i].d_nameOff = names.size();
+		table[i].d_nameLen = name.size();
+		names += name;
+	}
+	h.d_namesOff = sizeof(_IndexHeader) + _align( sizeof(_File) * qint64( table.size() ) );
+	h.d_postOff = h.d_namesOff + _align( names.size() );
+	bool ok = _write( tmp, &h, sizeof(h) ) && _write( tmp, table.constData(), sizeof(_File) * qint64( table.size() ) ) &&
+			_write( tmp, names.constData(), names.size() );
+
+	// the old and the new lists are merged in the order of the trigrams
+	QList<quint32> keys = added.keys();
+	qSort( keys );
+	const _Trigram* oldTable = ( d_map != 0 ) ? _table( d_map ) : 0;
+	const int oldTrigrams = ( d_map != 0 ) ? _header( d_map )->d_trigramCount : 0;
+	QVector<_Trigram> trigrams;
+	QVector<quint32> a;
+	QVector<quint32> b;
+	QVector<quint32> ids;
+	QByteArray buf;
+	qint64 off = 0;
+	int i = 0;
+	int j = 0;
+	int steps = 0;
+	while( ok && ( i < oldTrigrams || j < keys.size() ) )
+	{
+		if( ( ++steps & 0xfff ) == 0 && _cancelled( cancel ) )
+			return QString();
+		const quint32 t = ( j >= keys.size() || ( i < oldTrigrams && oldTable[i].d_trigram <= keys[j] ) ) ?
+					oldTable[i].d_trigram : keys[j];
+		a.clear();
+		if( i < oldTrigrams && oldTable[i].d_trigram == t )
+		{
+			_decode( d_map + _header( d_map )->d_postOff + oldTable[i].d_off, oldTable[i].d_count, a );
+			int n = 0;
+			for( int k = 0; k < a.size(); k++ )
+			{
+				const int id = renumber[ a[k] ];
+				if( id != -1 )
+					a[n++] = id;
+			}
+			a.resize( n );
+			i++;
+		}
+		b.clear();
+		if( j < keys.size() && keys[j] == t )
+		{
+			const _Postings& p = added.constFind( t ).value();
+			_decode( reinterpret_cast<const uchar*>( p.d_list.constData() ), p.d_count, b );
+			j++;
+		}
+		_merge( a, b, ids );
+		if( ids.isEmpty() )
+			continue; // only in files which changed or are gone
+		_encode( ids, buf );
+		_Trigram e;
+		e.d_trigram = t;
+		e.d_count = ids.size();
+		e.d_off = off;
+		trigrams.append( e );
+		ok = tmp.write( buf ) == buf.size();
+		off += buf.size();
+	}
+	h.d_tableOff = h.d_postOff + _align( off );
+	h.d_trigramCount = trigrams.size();
+	h.d_size = h.d_tableOff + qint64( sizeof(_Trigram) ) * trigrams.size();
+	ok = ok && _pad( tmp, off ) && _write( tmp, trigrams.constData(), sizeof(_Trigram) * qint64( trigrams.size() ) ) &&
+			tmp.seek( 0 ) && tmp.write( reinterpret_cast<const char*>( &h ), sizeof(h) ) == qint64( sizeof(h) ) &&
+			tmp.flush();
+#ifndef Q_OS_WIN
+	ok = ok && ::fsync( tmp.handle() ) == 0; // the contents are on disk before the name is
+#endif
+	if( !ok )
+		return QString();
+	tmp.setAutoRemove( false ); // removed or renamed by commitUpdate()
+	return tmp.fileName();
+}
+
+bool TrigramIndex::commitUpdate(const QString& file)
+{
+	// unmapped first, since a mapped file cannot be replaced on all systems
+	close();
+	const QString name = getIndexFile();
+	QFile::remove( name );
+	if( !QFile::rename( file, name ) )
+	{
+		QFile::remove( file );
+		return false;
+	}
+	return open();
+}
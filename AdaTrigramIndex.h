@@ -0,0 +1,86 @@
+#ifndef ADATRIGRAMINDEX_H
+#define ADATRIGRAMINDEX_H
+
+/*
+* Copyright 2012-2017 Rochus Keller <mailto:me@rochus-keller.info>
+*
+* This file is part of the AdaViewer application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.info.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <QString>
+#include <QList>
+#include <QVector>
+#include <QFile>
+#include <QAtomicInt>
+
+namespace Ada
+{
+	// Index of the trigrams of all .ads and .adb files below a root directory, so a text is found in
+	// the tree without reading every file. The trigrams are taken from the case folded text of the
+	// tokens the lexer finds, including comments and the text between tokens unless it contains
+	// whitespace; so only the trigrams of a query which contain no whitespace are looked up, and the
+	// files they all occur in are then searched for the query.
+	// The index is one file, named after the root, which is memory-mapped and used in place. update()
+	// only lexes the files whose size or modification time changed and writes the index under a
+	// temporary name, which replaces the old one when complete. The const functions only read the
+	// mapped file, so prepareUpdate() and find() may run in worker threads while the index is
+	// queried; commitUpdate() must wait until they are done.
+	class TrigramIndex
+	{
+	public:
+		struct Hit
+		{
+			QString d_path; // absolute
+			int d_line;
+			int d_col;
+			QString d_text; // of the line
+			Hit():d_line(0),d_col(0) {}
+		};
+		typedef QList<Hit> Hits;
+
+		TrigramIndex( const QString& root, const QString& dir ); // the index file is kept in dir
+		~TrigramIndex();
+		const QString& getRoot() const { return d_root; }
+		QString getIndexFile() const;
+		bool open(); // maps the index file if it exists and belongs to the root
+		void close();
+		bool update(); // rescans the tree and replaces the index; false if there is none afterwards
+		// writes the rescanned index under a temporary name, which is returned; empty if the index
+		// is up to date, could not be written or *cancel was set meanwhile
+		QString prepareUpdate( const QAtomicInt* cancel = 0 ) const;
+		bool commitUpdate( const QString& file ); // replaces the index by the file of prepareUpdate()
+		bool isOpen() const { return d_map != 0; }
+		int getFileCount() const;
+		QString getPath( int file ) const; // absolute
+		QVector<quint32> candidates( const QString& query ) const; // ascending ids of the files which may contain it
+		// reads the candidates; stops after maxHits or at the next file once *cancel is set
+		Hits find( const QString& query, bool caseSensitive = false, int maxHits = 1000,
+				   const QAtomicInt* cancel = 0 ) const;
+		// trigrams of the Latin-1 text of a file, which is lexed without converting it; sorted, without duplicates
+		static void extract( const QByteArray& latin1, QVector<quint32>& trigrams );
+	protected:
+		QString getName( int file ) const; // relative to the root
+		bool postings( quint32 trigram, const uchar*& p, quint32& count ) const;
+	private:
+		QString d_root; // canonical
+		QString d_dir;
+		QFile d_file;
+		uchar* d_map;
+		qint64 d_size;
+	};
+}
+
+#endif // ADATRIGRAMINDEX_H
@@ -20,15 +20,45 @@
 #include "AdaViewer.h"
 #include <QApplication>
 #include <QFileInfo>
+#include <QDesktopServices>
+#include <QShortcut>
+#include <QListWidget>
+#include <QDockWidget>
+#include <QInputDialog>
+#include <QFileDialog>
+#include <QMessageBox>
+#include <QSettings>
+#include <QDir>
+#include <QtConcurrentRun>
+#include "AdaTokenCache.h"
+
+static const int s_maxHits = 1000;
 
 AdaViewer::AdaViewer(QWidget *parent)
-	: QMainWindow(parent)
+	: QMainWindow(parent),d_index(0),d_indexing(false),d_searching(false),d_searchPending(false)
 {
 	d_edit = new Ada::Editor(this);
 	d_edit->installDefaultPopup();
 	d_edit->setReadOnly(true);
+	d_cache = new Ada::TokenCache( QDesktopServices::storageLocation( QDesktopServices::CacheLocation ) +
+								   QLatin1String("/tokens") );
+	d_edit->setTokenCache( d_cache );
 	setCentralWidget( d_edit );
 
+	d_hits = new QListWidget( this );
+	d_hitsDock = new QDockWidget( tr("Search Results"), this );
+	d_hitsDock->setObjectName( QLatin1String("SearchResults") );
+	d_hitsDock->setWidget( d_hits );
+	addDockWidget( Qt::BottomDockWidgetArea, d_hitsDock );
+	d_hitsDock->hide();
+	connect( d_hits, SIGNAL(itemActivated(QListWidgetItem*)), this, SLOT(onHit(QListWidgetItem*)) );
+	QShortcut* search = new QShortcut( tr("CTRL+SHIFT+F"), this );
+	connect( search, SIGNAL(activated()), this, SLOT(onSearchTree()) );
+	QShortcut* refresh = new QShortcut( tr("F5"), this );
+	connect( refresh, SIGNAL(activated()), this, SLOT(onRefreshIndex()) );
+	connect( &d_indexer, SIGNAL(finished()), this, SLOT(onIndexed()) );
+	connect( &d_searcher, SIGNAL(finished()), this, SLOT(onSearched()) );
+
 	showMaximized();
 
 	connect( d_edit,SIGNAL(updateCaption(QString)), this, SLOT(onCaption(QString)) );
@@ -38,12 +68,193 @@ AdaViewer::AdaViewer(QWidget *parent)
 
 AdaViewer::~AdaViewer()
 {
-	
+	delete d_edit; // the highlighter may still store tokens in d_cache
+	delete d_cache;
+	stopWorkers();
+	delete d_index;
 }
 
 void AdaViewer::open(const QString & path)
 {
+	d_path = path;
 	d_edit->loadFromFile(path);
+	// the index of the tree searched before is brought up to date in the background
+	const QString root = QSettings().value( "AdaViewer/SearchRoot" ).toString();
+	if( isInTree( root ) )
+		setSearchTree( root );
+}
+
+bool AdaViewer::isInTree(const QString& root) const
+{
+	if( root.isEmpty() || !QFileInfo( root ).isDir() )
+		return false;
+	return d_path.isEmpty() ||
+			QFileInfo( d_path ).canonicalFilePath().startsWith( QFileInfo( root ).canonicalFilePath() + QLatin1Char('/') );
+}
+
+void AdaViewer::setSearchTree(const QString& root)
+{
+	if( d_index != 0 && d_index->getRoot() == QFileInfo( root ).canonicalFilePath() )
+		return;
+	stopWorkers();
+	delete d_index;
+	d_index = new Ada::TrigramIndex( root, QDesktopServices::storageLocation( QDesktopServices::CacheLocation ) +
+									 QLatin1String("/trigrams") );
+	d_index->open(); // queries are answered from the old index until the rescan is done
+	onRefreshIndex();
+}
+
+void AdaViewer::stopWorkers()
+{
+	// both stop at the next file, so this does not wait long
+	d_stopIndexer = 1;
+	d_stopSearch = 1;
+	d_indexer.waitForFinished();
+	d_searcher.waitForFinished();
+	d_stopIndexer = 0;
+	d_stopSearch = 0;
+	d_searching = false;
+	d_searchPending = false;
+	if( d_indexing )
+		takeIndex(); // its finished() is ignored by onIndexed()
+	commitIndex();
+}
+
+void AdaViewer::onSearchTree()
+{
+	// the tree is asked for if the open file is not in the one searched before
+	QSettings set;
+	QString root = set.value( "AdaViewer/SearchRoot" ).toString();
+	if( !isInTree( root ) )
+	{
+		root = QFileDialog::getExistingDirectory( this, tr("Select the Tree to Search"),
+												  ( d_path.isEmpty() ) ? root : QFileInfo( d_path ).absolutePath() );
+		if( root.isEmpty() )
+			return;
+		set.setValue( "AdaViewer/SearchRoot", root );
+	}
+	bool ok = false;
+	const QString query = QInputDialog::getText( this, tr("Search Tree"), tr("Find in %1:").arg( root ),
+				QLineEdit::Normal, ( d_edit->hasSelection() ) ? d_edit->selectedText() : d_query, &ok );
+	if( !ok || query.isEmpty() )
+		return;
+	d_query = query;
+	setSearchTree( root );
+	startSearch();
+}
+
+void AdaViewer::onRefreshIndex()
+{
+	if( d_index == 0 )
+	{
+		const QString root = QSettings().value( "AdaViewer/SearchRoot" ).toString();
+		if( isInTree( root ) )
+			setSearchTree( root ); // starts the rescan
+		return;
+	}
+	if( d_indexing )
+		return;
+	commitIndex(); // the rescan starts from the newest index
+	// only the files changed since the last rescan are lexed again
+	d_indexing = true;
+	d_indexer.setFuture( QtConcurrent::run( d_index, &Ada::TrigramIndex::prepareUpdate, &d_stopIndexer ) );
+}
+
+void AdaViewer::onIndexed()
+{
+	if( !d_indexing || d_indexer.isRunning() )
+		return; // of a rescan stopped by stopWorkers()
+	takeIndex();
+	commitIndex();
+	if( !d_searchPending )
+		return;
+	if( d_index->isOpen() )
+		startSearch();
+	else
+	{
+		d_searchPending = false;
+		d_hitsDock->hide();
+		QMessageBox::critical( this, tr("Search Tree"), tr("Cannot write the index of %1").arg( d_index->getRoot() ) );
+	}
+}
+
+void AdaViewer::takeIndex()
+{
+	d_indexing = false;
+	if( !d_newIndex.isEmpty() )
+		QFile::remove( d_newIndex ); // not yet committed, and older than the result
+	d_newIndex = d_indexer.result();
+}
+
+void AdaViewer::commitIndex()
+{
+	// only when no worker reads the mapped index; else when the last one is done
+	if( d_newIndex.isEmpty() || d_indexer.isRunning() || d_searcher.isRunning() )
+		return;
+	d_index->commitUpdate( d_newIndex );
+	d_newIndex.clear();
+}
+
+void AdaViewer::startSearch()
+{
+	if( d_searching )
+	{
+		d_stopSearch = 1;
+		d_searcher.waitForFinished();
+		d_stopSearch = 0;
+		d_searching = false;
+	}
+	commitIndex();
+	if( !d_index->isOpen() )
+	{
+		// the first index of the tree is made by the rescan
+		d_searchPending = true;
+		onRefreshIndex();
+		d_hits->clear();
+		d_hitsDock->setWindowTitle( tr("Indexing %1...").arg( d_index->getRoot() ) );
+		d_hitsDock->show();
+		return;
+	}
+	d_searchPending = false;
+	// the candidates are read by a worker; the hits are capped at s_maxHits
+	d_searching = true;
+	d_searcher.setFuture( QtConcurrent::run( d_index, &Ada::TrigramIndex::find, d_query, false, s_maxHits,
+											 &d_stopSearch ) );
+	d_hits->clear();
+	d_hitsDock->setWindowTitle( tr("Searching '%1'...").arg( d_query ) );
+	d_hitsDock->show();
+}
+
+void AdaViewer::onSearched()
+{
+	if( !d_searching || d_searcher.isRunning() )
+		return; // of a search stopped by startSearch() or stopWorkers()
+	d_searching = false;
+	const Ada::TrigramIndex::Hits hits = d_searcher.result();
+	commitIndex(); // if the rescan finished meanwhile
+
+	d_hits->clear();
+	const QDir dir( d_index->getRoot() );
+	for( int i = 0; i < hits.size(); i++ )
+	{
+		QListWidgetItem* item = new QListWidgetItem( QString::fromLatin1("%1:%2: %3").
+				arg( dir.relativeFilePath( hits[i].d_path ) ).arg( hits[i].d_line + 1 ).arg( hits[i].d_text.trimmed() ), d_hits );
+		item->setData( Qt::UserRole, hits[i].d_path );
+		item->setData( Qt::UserRole + 1, hits[i].d_line );
+		item->setData( Qt::UserRole + 2, hits[i].d_col );
+	}
+	d_hitsDock->setWindowTitle( tr("%1 hits of '%2'").arg( hits.size() ).arg( d_query ) );
+	d_hitsDock->show();
+}
+
+void AdaViewer::onHit(QListWidgetItem* item)
+{
+	const QString path = item->data( Qt::UserRole ).toString();
+	if( path != d_path )
+		open( path );
+	const int line = item->data( Qt::UserRole + 1 ).toInt();
+	const int col = item->data( Qt::UserRole + 2 ).toInt();
+	d_edit->setSelection( line, col, line, col + d_query.size() );
 }
 
 void AdaViewer::onCaption(const QString & path)
@@ -55,6 +266,7 @@ void AdaViewer::onCaption(const QString & path)
 int main(int argc, char *argv[])
 {
 	QApplication a(argc, argv);
+	a.setApplicationName( QLatin1String("AdaViewer") ); // for the cache location and the settings
 
 	QString path;
 	QStringList args = a.arguments();
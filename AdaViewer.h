@@ -21,7 +21,14 @@
 */
 
 #include <QMainWindow>
+#include <QFutureWatcher>
+#include <QAtomicInt>
 #include "AdaEditor.h"
+#include "AdaTrigramIndex.h"
+
+class QListWidget;
+class QListWidgetItem;
+class QDockWidget;
 
 class AdaViewer : public QMainWindow
 {
@@ -33,8 +40,34 @@ public:
 	void open(const QString&);
 protected slots:
 	void onCaption( const QString& );
+	void onSearchTree();
+	void onRefreshIndex();
+	void onIndexed();
+	void onSearched();
+	void onHit( QListWidgetItem* );
+protected:
+	bool isInTree( const QString& root ) const; // the open file is below the root
+	void setSearchTree( const QString& root );
+	void startSearch();
+	void stopWorkers();
+	void takeIndex();
+	void commitIndex();
 private:
 	Ada::Editor* d_edit;
+	Ada::TokenCache* d_cache;
+	Ada::TrigramIndex* d_index; // of the tree searched last
+	QFutureWatcher<QString> d_indexer; // rescans the tree of d_index
+	QFutureWatcher<Ada::TrigramIndex::Hits> d_searcher; // reads the candidates of d_query
+	QAtomicInt d_stopIndexer;
+	QAtomicInt d_stopSearch;
+	QString d_newIndex;  // made by d_indexer; replaces the index once no worker reads it
+	bool d_indexing;     // the result of d_indexer was not yet taken
+	bool d_searching;    // the result of d_searcher was not yet taken
+	bool d_searchPending; // d_query waits for the first index of the tree
+	QDockWidget* d_hitsDock;
+	QListWidget* d_hits;
+	QString d_path; // of the open file
+	QString d_query;
 };
 
 #endif // ADAVIEWER_H
@@ -20,12 +20,26 @@ SOURCES +=\
         AdaViewer.cpp \
     AdaLexer.cpp \
     AdaHighlighter.cpp \
-    AdaEditor.cpp
+    AdaEditor.cpp \
+    AdaTokenStore.cpp \
+    AdaScanKernels.cpp \
+    AdaByteLexer.cpp \
+    AdaDeclIndex.cpp \
+    AdaTokenCache.cpp \
+    AdaFindEngine.cpp \
+    AdaTrigramIndex.cpp
 
 HEADERS  += AdaViewer.h \
     AdaLexer.h \
     AdaHighlighter.h \
-    AdaEditor.h
+    AdaEditor.h \
+    AdaTokenStore.h \
+    AdaScanKernels.h \
+    AdaByteLexer.h \
+    AdaDeclIndex.h \
+    AdaTokenCache.h \
+    AdaFindEngine.h \
+    AdaTrigramIndex.h
 
 !include(../NAF/Gui2/Gui2.pri) {
 	 message( "Missing NAF Gui2" )
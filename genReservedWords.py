@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+#
+# Copyright 2012-2017 Rochus Keller <mailto:me@rochus-keller.info>
+#
+# This file is part of the AdaViewer application.
+#
+# GNU General Public License Usage
+# This file may be used under the terms of the GNU General Public
+# License (GPL) versions 2.0 or 3.0 as published by the Free Software
+# Foundation and appearing in the file LICENSE.GPL included in
+# the packaging of this file.
+#
+# Generator and check of the perfect hash of LexerCore::findReservedWord() in AdaLexer.cpp.
+#
+#   genReservedWords.py [AdaLexer.cpp]           checks that the multipliers of _hashWord() give each
+#                                                reserved word its own slot and that the table matches
+#   genReservedWords.py -generate [AdaLexer.cpp] searches new multipliers, e.g. after adding a reserved
+#                                                word, and prints _hashWord() and the table to paste
+#
+# The reserved words are taken from s_tokenName, from "abort" to "xor" like LexerCore::isKeyWord().
+
+import random
+import re
+import sys
+
+def reservedWords(src):
+	names = re.search(r'static const char\* s_tokenName\[\] =\s*\{(.*?)\};', src, re.S).group(1)
+	names = re.findall(r'"([^"]*)"', names)
+	return names[names.index("abort"):names.index("xor") + 1]
+
+def hashWord(mults, word):
+	# same as _hashWord(); the characters are folded with | 0x20
+	m1, m2, m3, m4 = mults
+	return ( ord(word[0]) * m1 + ord(word[-2]) * m2 + ord(word[-1]) * m3 + len(word) * m4 ) % 2**32 >> 24
+
+def table(mults, words):
+	slots = {}
+	for w in words:
+		h = hashWord(mults, w)
+		if h in slots:
+			return None
+		slots[h] = w
+	return slots
+
+def printCode(mults, slots):
+	print("static inline quint32 _hashWord( quint32 first, quint32 beforeLast, quint32 last, quint32 len )")
+	print("{")
+	print("\treturn ( first * %du + beforeLast * %du + last * %du + len * %du ) >> 24;" % tuple(mults))
+	print("}")
+	print()
+	print("\tstatic const quint8 s_reservedWords[256] =")
+	print("\t{")
+	cells = [ "T_" + slots[i] if i in slots else "T_Invalid" for i in range(256) ]
+	rows = [ ", ".join(cells[i:i + 8]) for i in range(0, 256, 8) ]
+	print(",\n".join("\t\t" + r for r in rows))
+	print("\t};")
+
+def check(src, words):
+	m = re.search(r'return \( first \* (\d+)u \+ beforeLast \* (\d+)u \+ last \* (\d+)u \+ len \* (\d+)u \) >> 24;', src)
+	mults = [ int(x) for x in m.groups() ]
+	slots = table(mults, words)
+	if slots is None:
+		print("two reserved words share a slot of _hashWord()")
+		return 1
+	body = re.search(r'static const quint8 s_reservedWords\[256\] =\s*\{(.*?)\};', src, re.S).group(1)
+	cells = re.findall(r'T_(\w+)', body)
+	if len(cells) != 256:
+		print("s_reservedWords has %d instead of 256 entries" % len(cells))
+		return 1
+	errors = 0
+	for i, c in enumerate(cells):
+		expected = slots.get(i, "Invalid")
+		if c != expected:
+			print("slot %d is T_%s instead of T_%s" % (i, c, expected))
+			errors += 1
+	if errors == 0:
+		print("%d reserved words, each in its own slot" % len(words))
+	return 1 if errors else 0
+
+def main(args):
+	generate = "-generate" in args
+	args = [ a for a in args if a != "-generate" ]
+	path = args[0] if args else "AdaLexer.cpp"
+	src = open(path, encoding="latin-1").read()
+	words = reservedWords(src)
+	if len(max(words, key=len)) > 12:
+		print("findReservedWord() only looks at words of up to 12 characters")
+		return 1
+	if not generate:
+		return check(src, words)
+	rnd = random.Random(1)
+	while True:
+		mults = [ rnd.getrandbits(32) | 1 for _ in range(4) ]
+		slots = table(mults, words)
+		if slots is not None:
+			printCode(mults, slots)
+			return 0
+
+if __name__ == "__main__":
+	sys.exit(main(sys.argv[1:]))